@@ -14,10 +14,13 @@
 #include "TaskFuture.hpp"
 #include "ThreadExecutor.hpp"
 #include "TaskImpl.hpp"
+#include "IntrusivePtr.hpp"
 
 #include <atomic>
 #include <mutex>
 #include <utility>
+#include <type_traits>
+#include <new>
 
 #include <cassert>
 
@@ -40,10 +43,10 @@ void post(Ex& ex, Func&& func, Args&&... args)
 template<class R>
 struct async_result_invocation
 {
-	std::shared_ptr<AsyncResult<R>> ar;
+	IntrusivePtr<AsyncResult<R>> ar;
 
-	async_result_invocation(std::shared_ptr<AsyncResult<R>>& ar)
-		: ar(ar)
+	async_result_invocation(IntrusivePtr<AsyncResult<R>> ar)
+		: ar( std::move(ar) )
 	{}
 
 	void operator()( R r )
@@ -55,10 +58,10 @@ struct async_result_invocation
 template<>
 struct async_result_invocation<void>
 {
-	std::shared_ptr<AsyncResult<void>> ar;
+	IntrusivePtr<AsyncResult<void>> ar;
 
-	async_result_invocation(std::shared_ptr<AsyncResult<void>>& ar)
-		: ar(ar)
+	async_result_invocation(IntrusivePtr<AsyncResult<void>> ar)
+		: ar( std::move(ar) )
 	{}
 
 	void operator()()
@@ -67,6 +70,150 @@ struct async_result_invocation<void>
 	}
 };
 
+// Control block for as::async(): the task chain, the result storage
+// and the refcount share a single allocation.  The block is
+// simultaneously the ThreadWork queued on a ThreadExecutor and the
+// AsyncResult referenced by the returned TaskFuture.
+template<class Ret, class Func>
+class AsyncTaskBlock
+	: public ThreadWork
+	, public AsyncResult<Ret>
+{
+	typedef typename std::aligned_storage<sizeof(Func), alignof(Func)>::type storage_type;
+
+	storage_type storage;
+	bool has_func;
+
+	Func& func()
+	{
+		return *reinterpret_cast<Func *>( &storage );
+	}
+
+	void destroy_func()
+	{
+		if ( !has_func )
+			return;
+
+		has_func = false;
+		func().~Func();
+	}
+
+public:
+	// The block starts out with three references: the final link of
+	// the chain (dropped by destroying the chain once it has run), the
+	// TaskFuture and the executor queue
+	template<class Ex, class... Funcs>
+	explicit AsyncTaskBlock(Ex& ex, Funcs&&... funcs)
+		: has_func(false)
+	{
+		new (&storage) Func( build_chain( ex,
+		                                  std::forward<Funcs>(funcs)...,
+		                                  async_result_invocation<Ret>(
+			                                  IntrusivePtr<AsyncResult<Ret>>(this, false) ) ) );
+		has_func = true;
+
+		this->preset_refs( 3 );
+	}
+
+	~AsyncTaskBlock()
+	{
+		destroy_func();
+	}
+
+	AsyncTaskBlock(AsyncTaskBlock const&) = delete;
+	AsyncTaskBlock& operator=(AsyncTaskBlock const&) = delete;
+
+	TaskStatus Run()
+	{
+		if ( !has_func )
+			return TaskStatus::Finished;
+
+		if ( this->canceled() ) {
+			destroy_func();
+			this->abandon();
+
+			return TaskStatus::Canceled;
+		}
+
+		func()();
+		destroy_func();
+
+		return TaskStatus::Finished;
+	}
+
+	bool operator()()
+	{
+		Run();
+
+		return true;
+	}
+
+	void Release()
+	{
+		this->release();
+	}
+};
+
+// Hands the executor's reference on the block over to ex
+template<class Ex, class Ret, class Func>
+void schedule_block(Ex& ex, AsyncTaskBlock<Ret, Func> *block)
+{
+	typedef AsyncTaskBlock<Ret, Func> block_type;
+
+	schedule( ex, AsyncTask<block_type>( IntrusivePtr<block_type>(block, false) ) );
+}
+
+// ThreadExecutor queues the block itself; no wrapper is allocated
+template<class Ret, class Func>
+void schedule_block(ThreadExecutor& ex, AsyncTaskBlock<Ret, Func> *block)
+{
+	ex.ScheduleWork( block );
+}
+
+template<class Ret, class Func>
+void schedule_block(ThreadExecutorImpl *ex, AsyncTaskBlock<Ret, Func> *block)
+{
+	ex->ScheduleWork( block );
+}
+
+// What a pending continuation keeps of its executor: a copy of the
+// caller's handle, which may be gone by the time it is dispatched
+template<class Ex, class Enable = void>
+struct continuation_executor
+{
+	typedef Ex type;
+
+	static Ex const& hold(Ex& ex)
+	{
+		return ex;
+	}
+};
+
+// An executor only known by its interface has to outlive it
+template<class Ex>
+struct continuation_executor<Ex, typename std::enable_if< std::is_abstract<Ex>::value >::type>
+{
+	typedef Ex& type;
+
+	static Ex& hold(Ex& ex)
+	{
+		return ex;
+	}
+};
+
+// The executor itself rather than another handle to it, which could
+// end up being the last one, dropped on the executor's own thread
+template<>
+struct continuation_executor<ThreadExecutor>
+{
+	typedef ThreadExecutorImpl *type;
+
+	static ThreadExecutorImpl *hold(ThreadExecutor& ex)
+	{
+		return ex.Impl();
+	}
+};
+
 template<class ArgTuple, class Enable = void>
 struct invoker_impl;
 
@@ -83,16 +230,20 @@ struct invoker_impl<std::tuple<Ex, Args...>,
 	template<class E, class... Funcs>
 	static future_type async(E&& ex, Funcs&&... funcs)
 	{
-		auto r = std::make_shared<AsyncResult<result_type>>();
+		typedef decltype( build_chain( ex,
+		                               std::forward<Funcs>(funcs)...,
+		                               std::declval< async_result_invocation<result_type> >() )
+		                ) chain_type;
+
+		typedef AsyncTaskBlock<result_type, chain_type> block_type;
 
-		auto c = build_chain( ex,
-		                      std::forward<Funcs>(funcs)...,
-		                      async_result_invocation<result_type>(r)
-		                    );
+		auto block = new block_type( ex, std::forward<Funcs>(funcs)... );
 
-		schedule( ex, AsyncTask<result_type, decltype(c)>( std::move(c), r ) );
+		future_type fut{ IntrusivePtr<AsyncResult<result_type>>( block, false ) };
 
-		return {std::move(r)};
+		schedule_block( ex, block );
+
+		return fut;
 	}
 };
 
@@ -130,6 +281,119 @@ auto async(Args&&... args)
 	return invoker<Args...>::async( std::forward<Args>(args)... );
 }
 
+// Control block of a TaskFuture::then() continuation; it waits on the
+// antecedent's continuation list and is scheduled like as::async()
+template<class Ex, class Ret, class Func>
+class AsyncContinuationBlock
+	: public AsyncTaskBlock<Ret, Func>
+	, public AsyncContinuation
+{
+	typedef AsyncTaskBlock<Ret, Func> block_type;
+
+	typename continuation_executor<Ex>::type ex;
+
+public:
+	template<class... Funcs>
+	explicit AsyncContinuationBlock(Ex& ex, Funcs&&... funcs)
+		: block_type( ex, std::forward<Funcs>(funcs)... )
+		, ex( continuation_executor<Ex>::hold( ex ) )
+	{}
+
+	void Dispatch()
+	{
+		schedule_block( ex, static_cast<block_type *>(this) );
+	}
+
+	void Discard()
+	{
+		this->cancel();
+		this->Run();
+		this->Release();
+	}
+};
+
+// Feeds the antecedent's value into the continuation functor; then()
+// has claimed the value for it, so it is moved in
+template<class T, class Func>
+struct future_invocation
+{
+	IntrusivePtr<AsyncResult<T>> src;
+	invocation<Func> inv;
+
+	template<class F>
+	future_invocation(IntrusivePtr<AsyncResult<T>> src, F&& f)
+		: src( std::move(src) )
+		, inv( std::forward<F>(f) )
+	{}
+
+	auto operator()()
+		-> decltype( inv( std::declval<T>() ) )
+	{
+		return inv( src->get() );
+	}
+};
+
+template<class Func>
+struct future_invocation<void, Func>
+{
+	IntrusivePtr<AsyncResult<void>> src;
+	invocation<Func> inv;
+
+	template<class F>
+	future_invocation(IntrusivePtr<AsyncResult<void>> src, F&& f)
+		: src( std::move(src) )
+		, inv( std::forward<F>(f) )
+	{}
+
+	auto operator()()
+		-> decltype( inv() )
+	{
+		src->get();
+		return inv();
+	}
+};
+
+template<class T>
+template<class Ex, class Func>
+TaskFuture< typename ContinuationResultOf<T, Func>::type >
+TaskFuture<T>::then(Ex& ex, Func&& func)
+{
+	typedef typename ContinuationResultOf<T, Func>::type result_type;
+	typedef future_invocation<T, typename std::decay<Func>::type> first_type;
+
+	typedef decltype( build_chain( ex,
+	                               std::declval<first_type>(),
+	                               std::declval< async_result_invocation<result_type> >() )
+	                ) chain_type;
+
+	typedef AsyncContinuationBlock<Ex, result_type, chain_type> block_type;
+
+	// the continuation is the value's only consumer
+	result->claim();
+
+	auto block = new block_type( ex, first_type( result, std::forward<Func>(func) ) );
+
+	TaskFuture<result_type> fut{ IntrusivePtr<AsyncResult<result_type>>( block, false ) };
+
+	// Already completed and we are on the target executor: no hop
+	if ( result->ready() && !result->failed() && ex.IsCurrent() ) {
+		block->Run();
+		block->Release();
+	} else {
+		result->add_continuation( block );
+	}
+
+	return fut;
+}
+
+template<class T>
+template<class Func>
+TaskFuture< typename ContinuationResultOf<T, Func>::type >
+TaskFuture<T>::then(Func&& func)
+{
+	return then( ThreadExecutor::GetDefault(), std::forward<Func>(func) );
+}
+
 } // namespace as
 
 #endif // AS_ASYNC_HPP
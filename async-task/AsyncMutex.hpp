@@ -0,0 +1,359 @@
+//
+//  AsyncMutex.hpp - Mutex, condition variable and semaphore for coroutines
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_ASYNC_MUTEX_HPP
+#define AS_ASYNC_MUTEX_HPP
+
+#include "CoroutineTaskImpl.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cassert>
+
+namespace as {
+
+// These block only the calling coroutine: a coroutine that has to wait
+// is parked (see this_task::suspend) and its executor thread goes on
+// running the others.  Anywhere a coroutine cannot be parked, e.g. on
+// a plain thread, they block the calling thread instead.
+//
+// Waiters are served in arrival order.  A release hands the mutex or
+// the permit straight to the longest waiting one, so a busy releaser
+// cannot take it back before the woken waiter gets to run.
+//
+//   as::AsyncMutex mut;
+//
+//   as::await( ex, [&]() {
+//       std::lock_guard<as::AsyncMutex> lock( mut );
+//       account.Withdraw( 100 );   // may suspend while holding mut
+//   } );
+
+namespace detail {
+
+// Somebody waiting for a hand-off; lives on the waiter's own stack
+struct AsyncWaiter
+{
+	AsyncWaiter *next;
+	TaskWaker *waker;	// nullptr for a blocked thread
+	bool granted;
+};
+
+// FIFO of waiters, guarded by its owner's mutex
+class AsyncWaitQueue
+{
+	AsyncWaiter *head;
+	AsyncWaiter *tail;
+	std::condition_variable cond;	// for blocked threads
+
+	// w is on the stack of a waiter that does not return before Grant
+	// has popped it, which GCC's -Wdangling-pointer cannot see
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdangling-pointer"
+#endif
+	void Push(AsyncWaiter *w)
+	{
+		w->next = nullptr;
+
+		if ( tail )
+			tail->next = w;
+		else
+			head = w;
+
+		tail = w;
+	}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic pop
+#endif
+
+	AsyncWaiter *Pop()
+	{
+		auto w = head;
+
+		head = w->next;
+
+		if ( !head )
+			tail = nullptr;
+
+		return w;
+	}
+
+public:
+	AsyncWaitQueue()
+		: head(nullptr)
+		, tail(nullptr)
+		, cond()
+	{}
+
+	AsyncWaitQueue(AsyncWaitQueue const&) = delete;
+	AsyncWaitQueue& operator=(AsyncWaitQueue const&) = delete;
+
+	~AsyncWaitQueue()
+	{
+		assert( !head && "destroyed with waiters" );
+	}
+
+	bool Empty() const
+	{
+		return head == nullptr;
+	}
+
+	// Queues the caller and returns, with lock released, once Grant
+	// has picked it.  A coroutine is armed before it is queued, so a
+	// Grant that comes before it has parked is fine.
+	void Wait(std::unique_lock<std::mutex>& lock)
+	{
+		AsyncWaiter self{ nullptr, this_task::waker(), false };
+
+		if ( self.waker )
+			self.waker->Arm();
+
+		Push( &self );
+
+		if ( self.waker ) {
+			lock.unlock();
+			this_task::suspend();
+			return;
+		}
+
+		cond.wait( lock, [&self]() { return self.granted; } );
+		lock.unlock();
+	}
+
+	// Wakes the longest waiting waiter; lock is released on return
+	void Grant(std::unique_lock<std::mutex>& lock)
+	{
+		auto w = Pop();
+		auto waker = w->waker;
+
+		w->granted = true;
+		lock.unlock();
+
+		// a blocked thread may return, taking w with it, as soon as
+		// the lock is released; only the parked coroutine's w stays
+		if ( waker )
+			waker->Wake();
+		else
+			cond.notify_all();
+	}
+
+	// Wakes every waiter; lock is released on return
+	void GrantAll(std::unique_lock<std::mutex>& lock)
+	{
+		AsyncWaiter *parked = nullptr;
+		bool blocked = false;
+
+		while( head ) {
+			auto w = Pop();
+
+			if ( w->waker ) {
+				w->next = parked;
+				parked = w;
+			} else {
+				blocked = true;
+			}
+
+			w->granted = true;
+		}
+
+		lock.unlock();
+
+		while( parked ) {
+			auto w = parked;
+			parked = w->next;
+
+			w->waker->Wake();
+		}
+
+		if ( blocked )
+			cond.notify_all();
+	}
+};
+
+} // namespace as::detail
+
+// Meets the Lockable requirements, so std::lock_guard and
+// std::unique_lock work with it
+class AsyncMutex
+{
+	std::mutex mut;
+	bool locked;
+	detail::AsyncWaitQueue waiters;
+
+public:
+	AsyncMutex()
+		: mut()
+		, locked(false)
+		, waiters()
+	{}
+
+	AsyncMutex(AsyncMutex const&) = delete;
+	AsyncMutex& operator=(AsyncMutex const&) = delete;
+
+	void lock()
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		if ( !locked ) {
+			locked = true;
+			return;
+		}
+
+		// unlock hands it over still locked
+		waiters.Wait( lock );
+	}
+
+	bool try_lock()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+
+		if ( locked )
+			return false;
+
+		locked = true;
+		return true;
+	}
+
+	void unlock()
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		assert( locked );
+
+		if ( waiters.Empty() ) {
+			locked = false;
+			return;
+		}
+
+		waiters.Grant( lock );
+	}
+};
+
+// Condition variable for any lock, AsyncMutex in particular.  Waiting
+// releases the lock and parks the coroutine; it is woken in FIFO order
+// and takes the lock back before wait returns.  There are no spurious
+// wakeups, but the condition may have changed again by then, so the
+// predicate versions are usually what you want.
+class AsyncConditionVariable
+{
+	std::mutex mut;
+	detail::AsyncWaitQueue waiters;
+
+public:
+	AsyncConditionVariable()
+		: mut()
+		, waiters()
+	{}
+
+	AsyncConditionVariable(AsyncConditionVariable const&) = delete;
+	AsyncConditionVariable& operator=(AsyncConditionVariable const&) = delete;
+
+	template<class Lock>
+	void wait(Lock& user_lock)
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		// queued before the user's lock is released, so a notify made
+		// under that lock cannot be missed
+		user_lock.unlock();
+		waiters.Wait( lock );
+
+		user_lock.lock();
+	}
+
+	template<class Lock, class Pred>
+	void wait(Lock& user_lock, Pred pred)
+	{
+		while( !pred() )
+			wait( user_lock );
+	}
+
+	void notify_one()
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		if ( !waiters.Empty() )
+			waiters.Grant( lock );
+	}
+
+	void notify_all()
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		waiters.GrantAll( lock );
+	}
+};
+
+// Counting semaphore; release hands permits to waiters before making
+// them available to anyone else
+class AsyncSemaphore
+{
+	std::mutex mut;
+	std::size_t count;
+	detail::AsyncWaitQueue waiters;
+
+public:
+	explicit AsyncSemaphore(std::size_t initial = 0)
+		: mut()
+		, count(initial)
+		, waiters()
+	{}
+
+	AsyncSemaphore(AsyncSemaphore const&) = delete;
+	AsyncSemaphore& operator=(AsyncSemaphore const&) = delete;
+
+	void acquire()
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		// waiters first, even if a permit is free right now
+		if ( count && waiters.Empty() ) {
+			--count;
+			return;
+		}
+
+		waiters.Wait( lock );
+	}
+
+	bool try_acquire()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+
+		if ( !count || !waiters.Empty() )
+			return false;
+
+		--count;
+		return true;
+	}
+
+	void release(std::size_t n = 1)
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		while( n && !waiters.Empty() ) {
+			--n;
+			waiters.Grant( lock );
+			lock.lock();
+		}
+
+		count += n;
+	}
+
+	std::size_t available()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		return count;
+	}
+};
+
+} // namespace as
+
+#endif // AS_ASYNC_MUTEX_HPP
@@ -185,7 +185,7 @@ public:
 	                                           >::type
 	        >
 	AsyncPtr( TaskFuture<U> res )
-		: ptr(), impl( std::make_shared<AsyncPtrSynchronizer<U> >(res) )
+		: ptr(), impl( std::make_shared<AsyncPtrSynchronizer<U> >( std::move(res) ) )
 	{}
 
 	template<class U,
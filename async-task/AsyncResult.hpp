@@ -16,6 +16,11 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <future>
+#include <exception>
+
+#include "IntrusivePtr.hpp"
+#include "Optional.hpp"
 
 namespace as {
 
@@ -42,24 +47,26 @@ template<class Ret>
 struct AsyncResultStorage
 	: AsyncResultStorageBase
 {
-	std::unique_ptr<Ret> res;
+	Optional<Ret> res;
 
 	template<class Func>
 	void operator()(Func&& func)
 	{
-		res.reset( new Ret( func() ) );
+		res.emplace( func() );
+		AsyncResultStorageBase::set();
 	}
 
 	template<class R>
 	void set(R&& r)
 	{
-		res.reset( new Ret( std::forward<R>(r) ) );
+		res.emplace( std::forward<R>(r) );
 		AsyncResultStorageBase::set();
 	}
 
-	Ret& get() const
+	// The stored value is handed over to the (single) consumer
+	Ret get()
 	{
-		return *res;
+		return std::move( *res );
 	}
 };
 
@@ -78,33 +85,165 @@ struct AsyncResultStorage<void>
 	void get() const {}
 };
 
-template<class Ret>
-class AsyncResult
+// Node registered on an AsyncResult to be notified once, when the
+// result is stored (Dispatch) or will never be stored (Discard); the
+// result hands its reference on the node over with the notification
+struct AsyncContinuation
 {
+	AsyncContinuation *next;
+
+	AsyncContinuation()
+		: next(nullptr)
+	{}
+
+	virtual ~AsyncContinuation() {}
+
+	virtual void Dispatch() = 0;
+	virtual void Discard() = 0;
+};
+
+class AsyncResultBase
+	: public RefCounted
+{
+protected:
 	mutable std::mutex mut;
 	std::condition_variable cond;
-	AsyncResultStorage<Ret> storage;
+	bool completed;
 	std::atomic<bool> is_canceled;
+	std::atomic<bool> retrieved;
+	std::exception_ptr error;
+	AsyncContinuation *continuations;
 
-public:
-	AsyncResult()
-		: is_canceled(false)
+	AsyncResultBase()
+		: completed(false)
+		, is_canceled(false)
+		, retrieved(false)
+		, error()
+		, continuations(nullptr)
 	{}
 
-	template<class R>
-	void set(R&& r)
+	~AsyncResultBase()
 	{
-		std::unique_lock<std::mutex> lock( mut );
-		storage.set( std::forward<R>(r) );
+		// Last reference is gone, so nothing can race with us here
+		while( auto c = continuations ) {
+			continuations = c->next;
+			c->Discard();
+		}
+	}
+
+	// Called with mut held right after the result has been stored;
+	// waiters are woken and continuations run outside of the lock
+	void complete(std::unique_lock<std::mutex>& lock)
+	{
+		completed = true;
+
+		auto conts = take_continuations();
 
 		cond.notify_all();
+		lock.unlock();
+
+		while( conts ) {
+			auto next = conts->next;
+			conts->Dispatch();
+			conts = next;
+		}
 	}
 
-	Ret get()
+	// Rethrows the error of an abandoned result
+	void wait(std::unique_lock<std::mutex>& lock)
+	{
+		cond.wait( lock, [this]() { return completed; } );
+
+		if ( error )
+			std::rethrow_exception( error );
+	}
+
+private:
+	// Detach the registered continuations in registration order
+	AsyncContinuation *take_continuations()
+	{
+		AsyncContinuation *conts = nullptr;
+
+		while( continuations ) {
+			auto next = continuations->next;
+			continuations->next = conts;
+			conts = continuations;
+			continuations = next;
+		}
+
+		return conts;
+	}
+
+public:
+	void add_continuation(AsyncContinuation *c)
 	{
 		std::unique_lock<std::mutex> lock( mut );
-		cond.wait( lock, [=]() { return storage.is_set(); } );
-		return storage.get();
+
+		if ( completed ) {
+			bool failed = static_cast<bool>( error );
+
+			lock.unlock();
+
+			if ( failed )
+				c->Discard();
+			else
+				c->Dispatch();
+
+			return;
+		}
+
+		c->next = continuations;
+		continuations = c;
+	}
+
+	// Unregisters c if it has not been notified yet; on false it has
+	// been (or is being) dispatched or discarded
+	bool remove_continuation(AsyncContinuation *c)
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		for ( auto p = &continuations; *p; p = &(*p)->next ) {
+			if ( *p == c ) {
+				*p = c->next;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// The result will never be stored: it completes with a
+	// broken_promise error for waiters, and pending continuations are
+	// dropped
+	void abandon()
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		if ( completed )
+			return;
+
+		error = std::make_exception_ptr(
+			std::future_error( std::future_errc::broken_promise ) );
+		completed = true;
+
+		auto conts = take_continuations();
+
+		cond.notify_all();
+		lock.unlock();
+
+		while( conts ) {
+			auto next = conts->next;
+			conts->Discard();
+			conts = next;
+		}
+	}
+
+	// The value goes to a single consumer; a second get() or then()
+	// would only find what the first one left behind
+	void claim()
+	{
+		if ( retrieved.exchange( true ) )
+			throw std::future_error( std::future_errc::future_already_retrieved );
 	}
 
 	void cancel()
@@ -120,52 +259,64 @@ public:
 	bool ready() const
 	{
 		std::unique_lock<std::mutex> lock( mut );
-		return storage.is_set();
+		return completed;
+	}
+
+	// Completed without a value, i.e. abandoned
+	bool failed() const
+	{
+		std::unique_lock<std::mutex> lock( mut );
+		return static_cast<bool>( error );
 	}
 };
 
-template<>
-class AsyncResult<void>
+template<class Ret>
+class AsyncResult
+	: public AsyncResultBase
 {
-	mutable std::mutex mut;
-	std::condition_variable cond;
-	bool result_set;
-	std::atomic<bool> is_canceled;
+	AsyncResultStorage<Ret> storage;
 
 public:
 	AsyncResult()
-		: result_set(false)
-		, is_canceled(false)
+		: storage()
 	{}
 
-	void set()
+	template<class R>
+	void set(R&& r)
 	{
 		std::unique_lock<std::mutex> lock( mut );
-		result_set = true;
+		storage.set( std::forward<R>(r) );
 
-		cond.notify_all();
+		complete( lock );
 	}
 
-	void get()
+	Ret get()
 	{
 		std::unique_lock<std::mutex> lock( mut );
-		cond.wait( lock, [=]() { return result_set; } );
+		wait( lock );
+		return storage.get();
 	}
+};
 
-	void cancel()
-	{
-		is_canceled = true;
-	}
+template<>
+class AsyncResult<void>
+	: public AsyncResultBase
+{
+public:
+	AsyncResult()
+	{}
 
-	bool canceled() const
+	void set()
 	{
-		return is_canceled;
+		std::unique_lock<std::mutex> lock( mut );
+
+		complete( lock );
 	}
 
-	bool ready() const
+	void get()
 	{
 		std::unique_lock<std::mutex> lock( mut );
-		return result_set;
+		wait( lock );
 	}
 };
 
@@ -14,9 +14,199 @@
 #include "Async.hpp"
 #include "Executor.hpp"
 #include "CoroutineTaskImpl.hpp"
+#include "Channel.hpp"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 namespace as {
 
+namespace detail {
+
+// ThreadExecutor work item for a coroutine that can be parked: while
+// suspended it sits on none of the executor's queues and only its
+// waker holds a reference, which Wake hands back via ScheduleWork.
+// It points at the executor itself, not at the ThreadExecutor handle
+// it was scheduled through, which may well be a temporary copy.  The
+// executor must outlive it; it does not share ownership, since a
+// coroutine finishing on the executor thread could then be the last
+// owner and have the thread join itself.
+template<class Coro>
+class CoroutineWork
+	: public ThreadWork
+	, public TaskWaker
+	, public RefCounted
+{
+	enum State {
+		Running,
+		Parking,
+		Woken,
+		Parked
+	};
+
+	// Wakes the coroutine when its sleep is over
+	struct WakeTimer
+		: public ThreadWork
+	{
+		CoroutineWork *owner;
+
+		bool operator()()
+		{
+			return true;
+		}
+
+		void Release()
+		{
+			owner->Wake();
+		}
+
+		// The executor is going away: the coroutine will not run
+		// again, so just drop the reference its Arm took
+		void Discard()
+		{
+			owner->release();
+		}
+	};
+
+	ThreadExecutorImpl *ex;
+	Coro coro;
+	std::atomic<int> state;
+	WakeTimer timer;
+
+public:
+	CoroutineWork(ThreadExecutor& ex, Coro&& c)
+		: ex( ex.Impl() )
+		, coro( std::move(c) )
+		, state( Running )
+	{
+		coro.SetWaker( this );
+		timer.owner = this;
+
+		// the executor's
+		this->preset_refs( 1 );
+	}
+
+	bool operator()()
+	{
+		auto r = coro.Invoke();
+
+		if ( r != TaskStatus::Suspended )
+			return r == TaskStatus::Finished || r == TaskStatus::Canceled;
+
+		int expected = Parking;
+
+		if ( state.compare_exchange_strong( expected, Parked,
+		                                    std::memory_order_acq_rel ) )
+			return true;
+
+		// Woken before it got here; just carry on
+		state.store( Running, std::memory_order_relaxed );
+		return false;
+	}
+
+	void Release()
+	{
+		this->release();
+	}
+
+	void Arm()
+	{
+		this->add_ref();
+		state.store( Parking, std::memory_order_release );
+	}
+
+	void Wake()
+	{
+		int expected = Parking;
+
+		if ( state.compare_exchange_strong( expected, Woken,
+		                                    std::memory_order_acq_rel ) ) {
+			this->release();
+			return;
+		}
+
+		assert( expected == Parked );
+
+		state.store( Running, std::memory_order_relaxed );
+		ex->ScheduleWork( this );
+	}
+
+	// A coroutine sleeps in one place at a time, so one timer will do
+	void WakeAt(std::chrono::steady_clock::time_point deadline)
+	{
+		ex->ScheduleWorkAt( &timer, deadline );
+	}
+};
+
+// Wakes one parked receiver, at most once
+class ChannelReceiveWaiter
+	: public ChannelObserver
+{
+	TaskWaker *waker;
+	bool fired;
+
+public:
+	explicit ChannelReceiveWaiter(TaskWaker *w)
+		: waker(w)
+		, fired(false)
+	{}
+
+	bool Notify()
+	{
+		if ( fired )
+			return false;
+
+		fired = true;
+		waker->Wake();
+
+		return true;
+	}
+
+	// Only meaningful once removed from the channel
+	bool Fired() const
+	{
+		return fired;
+	}
+};
+
+// Wakes a coroutine parked on a TaskFuture once the value is set or
+// will never be
+class FutureWaiter
+	: public AsyncContinuation
+{
+	TaskWaker *waker;
+
+public:
+	explicit FutureWaiter(TaskWaker *w)
+		: waker(w)
+	{}
+
+	void Dispatch()
+	{
+		waker->Wake();
+	}
+
+	void Discard()
+	{
+		waker->Wake();
+	}
+};
+
+template<class Ex, class Coro>
+void schedule_coroutine(Ex& ex, Coro&& ct)
+{
+	ex.schedule( std::move(ct) );
+}
+
+template<class Coro>
+void schedule_coroutine(ThreadExecutor& ex, Coro&& ct)
+{
+	ex.ScheduleWork( new CoroutineWork<Coro>( ex, std::move(ct) ) );
+}
+
+} // namespace as::detail
+
 // TODO: you can do this!! fighting brian~~* :D
 template<class Ex, class Func, class... Args>
 TaskFuture< decltype( std::declval<Func>()(std::declval<Args>()...) ) >
@@ -27,7 +217,7 @@ await(Ex& ex, Func&& func, Args&&... args)
 	auto bound = std::bind( std::forward<Func>(func), std::forward<Args>(args)... );
 	// invocation<decltype(bound)> inv( std::move(bound) );
 
-	auto r = std::make_shared<AsyncResult<result_type>>();
+	auto r = make_intrusive<AsyncResult<result_type>>();
 
 	auto c = build_chain( ex, std::move(bound), async_result_invocation<result_type>(r) );
 
@@ -35,7 +225,7 @@ await(Ex& ex, Func&& func, Args&&... args)
 
 	coro_task_type ct{ std::move(c) };
 
-	ex.schedule( std::move(ct) );
+	detail::schedule_coroutine( ex, std::move(ct) );
 
 	return{ std::move(r) };
 }
@@ -45,18 +235,93 @@ TaskFuture< decltype( std::declval<Func>()(std::declval<Args>()...) ) >
 await(Func&& func, Args&&... args)
 {
 	//GlibExecutor ctxt;
-	auto ctxt = ThreadExecutor::GetDefault();
+	auto& ctxt = ThreadExecutor::GetDefault();
 
 	return await( ctxt,
 	              std::forward<Func>(func),
 	              std::forward<Args>(args)... );
 }
 
-#define AWAIT( fut ) \
-	do {									\
-		as::this_task::yield(); \
-		std::this_thread::sleep_for( std::chrono::microseconds(1) ); \
-	} while ( !fut.ready() )
+namespace this_task {
+
+// Channel Get for coroutines: while the channel is empty only the
+// calling coroutine is parked, and the Put that fills it reschedules
+// the coroutine on its executor.  Anywhere a coroutine cannot be
+// parked this is a plain (thread blocking) Channel::Get.
+template<class T, class Impl>
+typename Channel<T, Impl>::result_type
+receive(Channel<T, Impl>& ch)
+{
+	typename Channel<T, Impl>::result_type out;
+
+	auto w = waker();
+
+	if ( !w )
+		return ch.Get();
+
+	for (;;) {
+		if ( ch.TryGet( out ) )
+			return out;
+
+		if ( !ch.IsOpen() )
+			return ch.Get();
+
+		detail::ChannelReceiveWaiter waiter( w );
+
+		w->Arm();
+		ch.AddObserver( &waiter );
+
+		// Raced with a Put/Close before the registration took
+		if ( ch.Ready() ) {
+			ch.RemoveObserver( &waiter );
+
+			if ( !waiter.Fired() )
+				w->Wake();
+
+			continue;
+		}
+
+		suspend();
+
+		ch.RemoveObserver( &waiter );
+	}
+}
+
+// Returns once fut is ready (or abandoned), without taking its value.
+// A coroutine that can be parked sleeps until the result arrives and
+// is then rescheduled on its executor; elsewhere this falls back to
+// yielding and polling.
+template<class T>
+void wait(TaskFuture<T>& fut)
+{
+	if ( fut.ready() )
+		return;
+
+	auto w = waker();
+
+	if ( !w ) {
+		do {
+			yield();
+			std::this_thread::sleep_for( std::chrono::microseconds(1) );
+		} while( !fut.ready() );
+
+		return;
+	}
+
+	detail::FutureWaiter waiter( w );
+
+	w->Arm();
+
+	// May dispatch right away if the value just arrived; Wake before
+	// suspend is fine
+	fut.add_continuation( &waiter );
+
+	suspend();
+}
+
+} // namespace as::this_task
+
+#define AWAIT( fut ) as::this_task::wait( fut )
 
 } // namespace as
 
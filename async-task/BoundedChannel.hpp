@@ -0,0 +1,288 @@
+//
+//  BoundedChannel.hpp - Blocking layer shared by the lock-free Channels
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_BOUNDED_CHANNEL_HPP
+#define AS_BOUNDED_CHANNEL_HPP
+
+#include "Channel.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+
+namespace as {
+
+namespace detail {
+
+// Implements the blocking Channel interface for a fixed-capacity
+// buffer in terms of the Derived buffer's non-blocking primitives:
+//
+//   bool TryPush(T&)                     moves from its argument on success
+//   bool TryPop(result_type&)
+//   size_t TryPushMany(It& first, size_t n)   advances first
+//   size_t TryPopMany(OutIt& out, size_t n)   advances out
+//   bool HasItem() const, bool HasRoom() const
+//
+// Threads only sleep when the buffer is full (producers) or empty
+// (consumers), and the fast paths never take a lock.
+template<class Derived, class T>
+class BoundedChannel
+{
+public:
+	typedef Optional<T> result_type;
+
+	static constexpr std::size_t default_capacity = 1024;
+
+private:
+	std::atomic<bool> finished;
+	std::atomic<bool> canceled;
+	ChannelSignal not_empty;
+	ChannelSignal not_full;
+
+	Derived& derived()
+	{
+		return static_cast<Derived&>( *this );
+	}
+
+	Derived const& derived() const
+	{
+		return static_cast<Derived const&>( *this );
+	}
+
+	bool ReadyToGet() const
+	{
+		return derived().HasItem() || !IsOpen();
+	}
+
+	bool ReadyToPut() const
+	{
+		return derived().HasRoom() || !IsOpen();
+	}
+
+protected:
+	BoundedChannel()
+		: finished(false)
+		, canceled(false)
+	{}
+
+	static std::size_t round_capacity(std::size_t capacity)
+	{
+		std::size_t n = 2;
+
+		while( n < capacity )
+			n <<= 1;
+
+		return n;
+	}
+
+public:
+	BoundedChannel(BoundedChannel const&) = delete;
+	BoundedChannel& operator=(BoundedChannel const&) = delete;
+
+	bool IsOpen() const
+	{
+		return !( finished || canceled );
+	}
+
+	// Blocks while the buffer is full; false if the channel was closed.
+	// A result without a value has nothing to deliver and is dropped.
+	bool Put(TaskResult<T>&& u)
+	{
+		for (;;) {
+			if ( !IsOpen() )
+				return false;
+
+			if ( !u.ret )
+				return true;
+
+			if ( derived().TryPush( *u.ret ) ) {
+				not_empty.NotifyOne();
+				return true;
+			}
+
+			not_full.Wait( [this]() { return ReadyToPut(); } );
+		}
+	}
+
+	bool TryPut(TaskResult<T>&& u)
+	{
+		if ( !IsOpen() )
+			return false;
+
+		if ( !u.ret )
+			return true;
+
+		if ( !derived().TryPush( *u.ret ) )
+			return false;
+
+		not_empty.NotifyOne();
+		return true;
+	}
+
+	// Blocks while the buffer is full; takes forward iterators.  Returns
+	// how many elements went in, short only if the channel was closed.
+	template<class It>
+	std::size_t PutMany(It first, It last)
+	{
+		std::size_t left = std::distance( first, last );
+		std::size_t put = 0;
+
+		while( left ) {
+			if ( !IsOpen() )
+				break;
+
+			auto k = derived().TryPushMany( first, left );
+
+			if ( k ) {
+				not_empty.NotifyMany( k );
+				put += k;
+				left -= k;
+				continue;
+			}
+
+			not_full.Wait( [this]() { return ReadyToPut(); } );
+		}
+
+		return put;
+	}
+
+	// Blocks while the buffer is empty; items still queued are handed
+	// out after Close/Cancel, then an empty result signals the end
+	result_type Get()
+	{
+		result_type out;
+
+		for (;;) {
+			if ( TryGet( out ) )
+				return out;
+
+			if ( !IsOpen() )
+				return TryGet( out ) ? std::move(out) : result_type();
+
+			not_empty.Wait( [this]() { return ReadyToGet(); } );
+		}
+	}
+
+	bool TryGet(result_type& out)
+	{
+		if ( !derived().TryPop( out ) )
+			return false;
+
+		not_full.NotifyOne();
+		return true;
+	}
+
+	template<class OutIt>
+	std::size_t TryGetMany(OutIt& out, std::size_t max)
+	{
+		auto k = max ? derived().TryPopMany( out, max ) : 0;
+
+		not_full.NotifyMany( k );
+		return k;
+	}
+
+	template<class OutIt>
+	std::size_t GetMany(OutIt out, std::size_t max)
+	{
+		for (;;) {
+			if ( auto k = TryGetMany( out, max ) )
+				return k;
+
+			if ( !IsOpen() )
+				return TryGetMany( out, max );
+
+			not_empty.Wait( [this]() { return ReadyToGet(); } );
+		}
+	}
+
+	template<class OutIt, class Rep, class Period>
+	std::size_t GetMany(OutIt out, std::size_t max,
+	                    std::chrono::duration<Rep,Period> const& dur)
+	{
+		auto deadline = std::chrono::steady_clock::now() + dur;
+
+		for (;;) {
+			if ( auto k = TryGetMany( out, max ) )
+				return k;
+
+			if ( !IsOpen() )
+				return TryGetMany( out, max );
+
+			auto now = std::chrono::steady_clock::now();
+
+			if ( now >= deadline ||
+			     !not_empty.WaitFor( deadline - now, [this]() { return ReadyToGet(); } ) )
+				return TryGetMany( out, max );
+		}
+	}
+
+	bool Ready() const
+	{
+		return ReadyToGet();
+	}
+
+	// Observers hear about new elements and Close/Cancel
+	void AddObserver(ChannelObserver *o)
+	{
+		not_empty.AddObserver( o );
+	}
+
+	void RemoveObserver(ChannelObserver *o)
+	{
+		not_empty.RemoveObserver( o );
+	}
+
+	void Ping()
+	{
+		not_empty.NotifyAll();
+		not_full.NotifyAll();
+	}
+
+	void Cancel()
+	{
+		canceled = true;
+		Ping();
+	}
+
+	void Close()
+	{
+		finished = true;
+		Ping();
+	}
+
+	void Wait()
+	{
+		if ( ReadyToGet() )
+			return;
+
+		not_empty.Wait( [this]() { return ReadyToGet(); } );
+	}
+
+	template<class Rep, class Period>
+	WaitStatus WaitFor( std::chrono::duration<Rep,Period> const& dur )
+	{
+		if ( ReadyToGet() )
+			return WaitStatus::Ready;
+
+		return not_empty.WaitFor( dur, [this]() { return ReadyToGet(); } )
+			? WaitStatus::Ready
+			: WaitStatus::Timeout;
+	}
+};
+
+template<class Derived, class T>
+constexpr std::size_t BoundedChannel<Derived, T>::default_capacity;
+
+} // namespace as::detail
+
+} // namespace as
+
+#endif // AS_BOUNDED_CHANNEL_HPP
@@ -0,0 +1,441 @@
+//
+//  BroadcastChannel.hpp - Single ring fan-out to many subscribers
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_BROADCAST_CHANNEL_HPP
+#define AS_BROADCAST_CHANNEL_HPP
+
+#include "Channel.hpp"
+#include "Optional.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+namespace as {
+
+// What Put does when the slowest subscriber is a full ring behind
+enum class BroadcastOverflow {
+	Block,		// wait for it to catch up
+	DropOldest	// overwrite; the subscriber skips ahead and is told how many it missed
+};
+
+// Every element is stored once, in a power-of-two ring; each
+// subscriber only owns a cursor into it.  A Put costs the same however
+// many subscribers there are, except when the ring is full and the
+// slowest cursor has to be found.  An element is destroyed once every
+// cursor has passed it, when the producer reclaims its slot or a
+// subscriber leaves.
+template<class T>
+class BroadcastChannelImpl
+{
+public:
+	typedef Optional<T> result_type;
+
+	static constexpr std::size_t default_capacity = 1024;
+
+	struct Subscriber
+	{
+		// Position of the next element; the top bit is set while the
+		// subscriber reads the slot, which keeps it from being
+		// overwritten under DropOldest
+		std::atomic<std::uint64_t> cursor;
+		std::atomic<std::uint64_t> missed;
+
+		explicit Subscriber(std::uint64_t pos)
+			: cursor(pos)
+			, missed(0)
+		{}
+	};
+
+private:
+	static constexpr std::uint64_t reading = std::uint64_t(1) << 63;
+
+	std::unique_ptr< Optional<T>[] > cells;
+	std::uint64_t mask;
+	BroadcastOverflow overflow;
+
+	std::atomic<std::uint64_t> tail;
+	std::uint64_t head;
+
+	std::mutex mut;
+	std::vector< Subscriber * > subscribers;
+
+	std::atomic<bool> finished;
+	detail::ChannelSignal not_empty;
+	detail::ChannelSignal not_full;
+
+	static std::uint64_t round_capacity(std::size_t capacity)
+	{
+		std::uint64_t n = 2;
+
+		while( n < capacity )
+			n <<= 1;
+
+		return n;
+	}
+
+	// Called with mut held; frees the slots every cursor has passed
+	void ReclaimLocked()
+	{
+		auto t = tail.load( std::memory_order_relaxed );
+		auto min = t;
+
+		for ( auto s : subscribers )
+			min = std::min( min, s->cursor.load( std::memory_order_acquire ) & ~reading );
+
+		for ( ; head < min; ++head )
+			cells[ head & mask ].reset();
+	}
+
+	bool FullLocked() const
+	{
+		return tail.load( std::memory_order_relaxed ) - head > mask;
+	}
+
+	// Called with mut held on a full ring: moves every cursor still on
+	// the oldest slot past it.  False if a subscriber is reading that
+	// slot; the caller has to let go of mut and retry once it is done,
+	// since the reader's callback may well need mut itself.
+	bool DropOldestLocked()
+	{
+		auto victim = head;
+		bool pinned = false;
+
+		for ( auto s : subscribers ) {
+			auto c = s->cursor.load( std::memory_order_acquire );
+
+			for (;;) {
+				if ( ( c & ~reading ) > victim )
+					break;
+
+				if ( c & reading ) {
+					pinned = true;
+					break;
+				}
+
+				if ( s->cursor.compare_exchange_weak( c, victim + 1,
+				                                      std::memory_order_acq_rel ) ) {
+					s->missed.fetch_add( victim + 1 - c, std::memory_order_relaxed );
+					break;
+				}
+			}
+		}
+
+		if ( pinned )
+			return false;
+
+		cells[ head & mask ].reset();
+		++head;
+
+		return true;
+	}
+
+	bool HasRoom()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+
+		ReclaimLocked();
+		return !FullLocked() || finished;
+	}
+
+public:
+	explicit BroadcastChannelImpl(std::size_t capacity = default_capacity,
+	                              BroadcastOverflow policy = BroadcastOverflow::Block)
+		: cells( new Optional<T>[ round_capacity(capacity) ] )
+		, mask( round_capacity(capacity) - 1 )
+		, overflow( policy )
+		, tail(0)
+		, head(0)
+		, mut()
+		, subscribers()
+		, finished(false)
+	{}
+
+	BroadcastChannelImpl(BroadcastChannelImpl const&) = delete;
+	BroadcastChannelImpl& operator=(BroadcastChannelImpl const&) = delete;
+
+	bool IsOpen() const
+	{
+		return !finished;
+	}
+
+	std::size_t Capacity() const
+	{
+		return mask + 1;
+	}
+
+	// Subscribers see the elements put after they subscribed
+	Subscriber *Subscribe()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+
+		auto s = new Subscriber( tail.load( std::memory_order_relaxed ) );
+		subscribers.push_back( s );
+
+		return s;
+	}
+
+	void Unsubscribe(Subscriber *s)
+	{
+		{
+			std::lock_guard<std::mutex> lock( mut );
+
+			subscribers.erase( std::find( subscribers.begin(), subscribers.end(), s ) );
+			delete s;
+
+			ReclaimLocked();
+		}
+
+		// may have been the one holding the producer back
+		not_full.NotifyAll();
+	}
+
+	std::size_t Subscribers()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		return subscribers.size();
+	}
+
+	// False if the channel was closed.  A result without a value has
+	// nothing to deliver and is dropped.
+	bool Put(TaskResult<T>&& u)
+	{
+		if ( !u.ret )
+			return IsOpen();
+
+		for (;;) {
+			{
+				std::lock_guard<std::mutex> lock( mut );
+
+				if ( finished )
+					return false;
+
+				if ( FullLocked() )
+					ReclaimLocked();
+
+				// a pinned oldest slot leaves the ring full: wait below
+				// for its reader, which notifies not_full when done
+				if ( FullLocked() && overflow == BroadcastOverflow::DropOldest )
+					DropOldestLocked();
+
+				if ( !FullLocked() ) {
+					auto t = tail.load( std::memory_order_relaxed );
+
+					cells[ t & mask ].emplace( std::move(*u.ret) );
+					tail.store( t + 1, std::memory_order_release );
+					break;
+				}
+			}
+
+			not_full.Wait( [this]() { return HasRoom(); } );
+		}
+
+		not_empty.NotifyAll();
+		return true;
+	}
+
+	void Close()
+	{
+		finished = true;
+
+		not_empty.NotifyAll();
+		not_full.NotifyAll();
+	}
+
+	// Hands the next element to f without copying it; the slot is
+	// pinned while f runs, and a full ring waits for it even under
+	// DropOldest.  f may use the channel, but not unsubscribe s.
+	// False once closed and drained.
+	template<class F>
+	bool Consume(Subscriber *s, F&& f)
+	{
+		for (;;) {
+			auto c = s->cursor.load( std::memory_order_acquire );
+
+			if ( c < tail.load( std::memory_order_acquire ) ) {
+				// fails if the producer just skipped us past this slot
+				if ( !s->cursor.compare_exchange_strong( c, c | reading,
+				                                         std::memory_order_acq_rel ) )
+					continue;
+
+				struct unpin {
+					Subscriber *s;
+					std::uint64_t next;
+					~unpin() { s->cursor.store( next, std::memory_order_release ); }
+				} guard{ s, c + 1 };
+
+				f( static_cast<T const&>( *cells[ c & mask ] ) );
+				break;
+			}
+
+			if ( !IsOpen() ) {
+				if ( c < tail.load( std::memory_order_acquire ) )
+					continue;
+
+				return false;
+			}
+
+			not_empty.Wait( [this, s]() {
+					return ( s->cursor.load( std::memory_order_acquire ) & ~reading ) <
+						tail.load( std::memory_order_acquire ) || !IsOpen();
+				} );
+		}
+
+		not_full.NotifyOne();
+		return true;
+	}
+
+	result_type Get(Subscriber *s)
+	{
+		result_type out;
+
+		Consume( s, [&out](T const& v) { out.emplace( v ); } );
+
+		return out;
+	}
+
+	// Elements overwritten before s got to them since the last call
+	std::uint64_t TakeMissed(Subscriber *s)
+	{
+		return s->missed.exchange( 0, std::memory_order_relaxed );
+	}
+
+	std::size_t Count(Subscriber const *s) const
+	{
+		auto c = s->cursor.load( std::memory_order_acquire ) & ~reading;
+		auto t = tail.load( std::memory_order_acquire );
+
+		return t > c ? t - c : 0;
+	}
+};
+
+template<class T>
+constexpr std::size_t BroadcastChannelImpl<T>::default_capacity;
+
+template<class T>
+constexpr std::uint64_t BroadcastChannelImpl<T>::reading;
+
+// A subscription; unsubscribes when destroyed
+template<class T>
+class BroadcastSubscriber
+{
+	typedef BroadcastChannelImpl<T> impl_type;
+
+	std::shared_ptr< impl_type > impl;
+	typename impl_type::Subscriber *sub;
+
+public:
+	typedef typename impl_type::result_type result_type;
+
+	BroadcastSubscriber(std::shared_ptr< impl_type > i)
+		: impl( std::move(i) )
+		, sub( impl->Subscribe() )
+	{}
+
+	BroadcastSubscriber(BroadcastSubscriber&& other)
+		: impl( std::move(other.impl) )
+		, sub( other.sub )
+	{
+		other.sub = nullptr;
+	}
+
+	BroadcastSubscriber& operator=(BroadcastSubscriber&& other)
+	{
+		std::swap( impl, other.impl );
+		std::swap( sub, other.sub );
+		return *this;
+	}
+
+	~BroadcastSubscriber()
+	{
+		if ( sub )
+			impl->Unsubscribe( sub );
+	}
+
+	// Blocks until the next element; empty once closed and drained
+	result_type Get()
+	{
+		return impl->Get( sub );
+	}
+
+	template<class F>
+	bool Consume(F&& f)
+	{
+		return impl->Consume( sub, std::forward<F>(f) );
+	}
+
+	std::uint64_t TakeMissed()
+	{
+		return impl->TakeMissed( sub );
+	}
+
+	size_t Count() const
+	{
+		return impl->Count( sub );
+	}
+};
+
+// Shared producer handle
+//
+//   as::BroadcastChannel<Quote> quotes( 4096 );
+//   auto sub = quotes.Subscribe();
+//   quotes.Put( as::continuing( q ) );
+//   sub.Consume( [](Quote const& q) { ... } );
+template<class T>
+class BroadcastChannel
+{
+	std::shared_ptr< BroadcastChannelImpl<T> > impl;
+
+public:
+	typedef typename BroadcastChannelImpl<T>::result_type result_type;
+
+	explicit BroadcastChannel(std::size_t capacity = BroadcastChannelImpl<T>::default_capacity,
+	                          BroadcastOverflow policy = BroadcastOverflow::Block)
+		: impl( std::make_shared< BroadcastChannelImpl<T> >( capacity, policy ) )
+	{}
+
+	BroadcastSubscriber<T> Subscribe()
+	{
+		return BroadcastSubscriber<T>( impl );
+	}
+
+	bool IsOpen() const
+	{
+		return impl->IsOpen();
+	}
+
+	bool Put(TaskResult<T> tfr)
+	{
+		return impl->Put( std::move(tfr) );
+	}
+
+	void Close()
+	{
+		impl->Close();
+	}
+
+	std::size_t Subscribers() const
+	{
+		return impl->Subscribers();
+	}
+
+	std::size_t Capacity() const
+	{
+		return impl->Capacity();
+	}
+};
+
+} // namespace as
+
+#endif // AS_BROADCAST_CHANNEL_HPP
@@ -15,22 +15,258 @@
 #include <future>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <deque>
 #include <vector>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
 
 #include "TaskStatus.hpp"
+#include "Optional.hpp"
+#include "ThisTask.hpp"
 
 namespace as {
 
+namespace detail {
+
+// Node registered on a channel to hear about state changes that may
+// make a Get ready (new elements, Close, Cancel), without taking
+// anything out of the channel.  Notify runs under the channel's lock
+// and must not call back into the channel.  An observer that stands
+// for a single receiver returns true when it accepted a wakeup, so
+// one new element wakes one receiver; others (e.g. select) return
+// false and hear about everything.
+struct ChannelObserver
+{
+	ChannelObserver *next;
+
+	ChannelObserver()
+		: next(nullptr)
+	{}
+
+	virtual ~ChannelObserver() {}
+
+	virtual bool Notify() = 0;
+};
+
+// Unsynchronized list; owners guard it with their own mutex
+class ChannelObserverList
+{
+	ChannelObserver *head;
+
+public:
+	static constexpr std::size_t all = std::size_t(-1);
+
+	ChannelObserverList()
+		: head(nullptr)
+	{}
+
+	void Add(ChannelObserver *o)
+	{
+		o->next = head;
+		head = o;
+	}
+
+	void Remove(ChannelObserver *o)
+	{
+		for ( auto p = &head; *p; p = &(*p)->next ) {
+			if ( *p == o ) {
+				*p = o->next;
+				return;
+			}
+		}
+	}
+
+	// Notifies every observer until n receivers accepted a wakeup
+	void Notify(std::size_t n = all)
+	{
+		for ( auto o = head; o; o = o->next ) {
+			if ( o->Notify() && !--n )
+				return;
+		}
+	}
+};
+
+// Sleep/wake helper for channels whose fast paths do not take a lock:
+// the mutex only orders a sleeping waiter against the notifier, and
+// notifiers skip it entirely while nobody is asleep.  A notified
+// sleeper is moved from `waiters` to `wakeups`, so a burst of
+// notifications before it gets to run costs a single wakeup.
+// Registered observers count as permanent waiters, so notifiers only
+// take the lock while someone is asleep or observing.
+class ChannelSignal
+{
+	std::mutex mut;
+	std::condition_variable cond;
+	std::atomic<unsigned> waiters;
+	unsigned wakeups;
+	unsigned generation;
+	unsigned observer_count;
+	ChannelObserverList observers;
+
+	unsigned SleepersLocked() const
+	{
+		return waiters.load( std::memory_order_relaxed ) - observer_count;
+	}
+
+public:
+	ChannelSignal()
+		: mut()
+		, cond()
+		, waiters(0)
+		, wakeups(0)
+		, generation(0)
+		, observer_count(0)
+		, observers()
+	{}
+
+	void AddObserver(ChannelObserver *o)
+	{
+		std::lock_guard<std::mutex> lock( mut );
+
+		observers.Add( o );
+		++observer_count;
+		waiters.fetch_add( 1, std::memory_order_acq_rel );
+	}
+
+	// Once this returns, o is no longer notified
+	void RemoveObserver(ChannelObserver *o)
+	{
+		std::lock_guard<std::mutex> lock( mut );
+
+		observers.Remove( o );
+		--observer_count;
+		waiters.fetch_sub( 1, std::memory_order_relaxed );
+	}
+
+	template<class Pred>
+	void Wait(Pred pred)
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		for (;;) {
+			waiters.fetch_add( 1, std::memory_order_acq_rel );
+
+			if ( pred() ) {
+				waiters.fetch_sub( 1, std::memory_order_relaxed );
+				return;
+			}
+
+			auto gen = generation;
+
+			cond.wait( lock, [this, gen]() { return wakeups > 0 || generation != gen; } );
+
+			if ( generation == gen )
+				--wakeups;
+		}
+	}
+
+	template<class Rep, class Period, class Pred>
+	bool WaitFor(std::chrono::duration<Rep,Period> const& dur, Pred pred)
+	{
+		auto deadline = std::chrono::steady_clock::now() + dur;
+
+		std::unique_lock<std::mutex> lock( mut );
+
+		for (;;) {
+			waiters.fetch_add( 1, std::memory_order_acq_rel );
+
+			if ( pred() ) {
+				waiters.fetch_sub( 1, std::memory_order_relaxed );
+				return true;
+			}
+
+			auto gen = generation;
+
+			if ( !cond.wait_until( lock, deadline, [this, gen]() {
+						return wakeups > 0 || generation != gen;
+					} ) ) {
+				// Still registered; keep the waiters/wakeups balance
+				waiters.fetch_sub( 1, std::memory_order_relaxed );
+				return pred();
+			}
+
+			if ( generation == gen )
+				--wakeups;
+		}
+	}
+
+	// Callers publish their state change before notifying.  Reading
+	// `waiters` with an RMW orders that change against a concurrent
+	// registration: either the waiter sees it, or we see the waiter.
+	void NotifyOne()
+	{
+		if ( !waiters.fetch_add( 0, std::memory_order_acq_rel ) )
+			return;
+
+		std::lock_guard<std::mutex> lock( mut );
+
+		observers.Notify( 1 );
+
+		if ( !SleepersLocked() )
+			return;
+
+		waiters.fetch_sub( 1, std::memory_order_relaxed );
+		++wakeups;
+		cond.notify_one();
+	}
+
+	// Wakes at most n sleepers, e.g. one per element of a batch
+	void NotifyMany(std::size_t n)
+	{
+		if ( !n || !waiters.fetch_add( 0, std::memory_order_acq_rel ) )
+			return;
+
+		std::lock_guard<std::mutex> lock( mut );
+
+		observers.Notify( n );
+
+		auto woken = static_cast<unsigned>( std::min<std::size_t>( SleepersLocked(), n ) );
+
+		waiters.fetch_sub( woken, std::memory_order_relaxed );
+		wakeups += woken;
+
+		if ( woken == 1 )
+			cond.notify_one();
+		else if ( woken )
+			cond.notify_all();
+	}
+
+	void NotifyAll()
+	{
+		if ( !waiters.fetch_add( 0, std::memory_order_acq_rel ) )
+			return;
+
+		std::lock_guard<std::mutex> lock( mut );
+
+		observers.Notify();
+
+		// Every current sleeper is woken by the generation change
+		// rather than a token, so one that wakes, finds nothing and
+		// sleeps again cannot take the turn of another still waking up.
+		// Matters when sleepers wait on different conditions.
+		++generation;
+		waiters.store( observer_count, std::memory_order_relaxed );
+		cond.notify_all();
+	}
+};
+
+} // namespace as::detail
+
 template<class T>
 struct ChannelImpl
 {
-	typedef std::unique_ptr<T> result_type;
+	// Values are held inline; an empty result means the channel was
+	// closed or canceled and nothing is left to receive
+	typedef Optional<T> result_type;
 
-	std::vector< result_type > results;
-	std::mutex results_mut;
-	std::condition_variable results_cond;
+	std::deque< T > results;
+	mutable std::mutex results_mut;
+	mutable std::condition_variable results_cond;
 	std::atomic<bool> finished;
 	std::atomic<bool> canceled;
+	detail::ChannelObserverList observers;
 
 	ChannelImpl()
 		: results()
@@ -38,6 +274,7 @@ struct ChannelImpl
 		, results_cond()
 		, finished(false)
 		, canceled(false)
+		, observers()
 	{}
 
 	bool IsOpen() const
@@ -45,31 +282,108 @@ struct ChannelImpl
 		return !( finished || canceled );
 	}
 
+	// A result without a value has nothing to deliver and is dropped;
+	// false once the channel is closed
 	template<class U>
-	void Put(TaskResult<U>&& u)
+	bool Put(TaskResult<U>&& u)
 	{
+		if ( !u.ret )
+			return IsOpen();
+
 		std::lock_guard<std::mutex> lock( results_mut );
 
-		results.push_back( std::move(u.ret) );
+		if ( !IsOpen() )
+			return false;
+
+		results.push_back( std::move(*u.ret) );
 
+		observers.Notify( 1 );
 		Ping();
+
+		return true;
+	}
+
+	// Appends [first, last) under a single lock acquisition; nothing
+	// once the channel is closed
+	template<class It>
+	std::size_t PutMany(It first, It last)
+	{
+		std::lock_guard<std::mutex> lock( results_mut );
+
+		if ( !IsOpen() )
+			return 0;
+
+		auto before = results.size();
+		results.insert( results.end(), first, last );
+
+		auto count = results.size() - before;
+
+		if ( count )
+			observers.Notify( count );
+		Ping();
+
+		return count;
 	}
 
 	result_type Get()
 	{
 		std::unique_lock<std::mutex> lock( results_mut );
 
-		results_cond.wait( lock, [=]() { return WaitConditionLocked(); } );
+		results_cond.wait( lock, [this]() { return WaitConditionLocked(); } );
+
+		result_type res;
 
 		if ( !results.size() )
-			return nullptr;
+			return res;
 
-		result_type res = std::move( results[0] );
-		results.erase( results.begin() );
+		res.emplace( std::move( results.front() ) );
+		results.pop_front();
 
 		return res;
 	}
 
+	template<class U>
+	bool TryPut(TaskResult<U>&& u)
+	{
+		return Put( std::move(u) );
+	}
+
+	bool TryGet(result_type& out)
+	{
+		std::lock_guard<std::mutex> lock( results_mut );
+
+		if ( results.empty() )
+			return false;
+
+		out.emplace( std::move( results.front() ) );
+		results.pop_front();
+
+		return true;
+	}
+
+	// Waits for the first element, then takes whatever else is
+	// queued (up to max) under the same lock
+	template<class OutIt>
+	std::size_t GetMany(OutIt out, std::size_t max)
+	{
+		std::unique_lock<std::mutex> lock( results_mut );
+
+		results_cond.wait( lock, [this]() { return WaitConditionLocked(); } );
+
+		return TakeLocked( out, max );
+	}
+
+	template<class OutIt, class Rep, class Period>
+	std::size_t GetMany(OutIt out, std::size_t max,
+	                    std::chrono::duration<Rep,Period> const& dur)
+	{
+		std::unique_lock<std::mutex> lock( results_mut );
+
+		results_cond.wait_for( lock, dur, [this]() { return WaitConditionLocked(); } );
+
+		return TakeLocked( out, max );
+	}
+
 	void Ping()
 	{
 		results_cond.notify_all();
@@ -77,13 +391,23 @@ struct ChannelImpl
 
 	void Cancel()
 	{
-		canceled = true;
+		{
+			std::lock_guard<std::mutex> lock( results_mut );
+			canceled = true;
+			observers.Notify();
+		}
+
 		Ping();
 	}
 
 	void Close()
 	{
-		finished = true;
+		{
+			std::lock_guard<std::mutex> lock( results_mut );
+			finished = true;
+			observers.Notify();
+		}
+
 		Ping();
 	}
 
@@ -91,7 +415,26 @@ struct ChannelImpl
 	{
 		std::unique_lock<std::mutex> lock( results_mut );
 
-		results_cond.wait( lock, [=]() { return WaitConditionLocked(); } );
+		results_cond.wait( lock, [this]() { return WaitConditionLocked(); } );
+	}
+
+	// True when Get would not block
+	bool Ready() const
+	{
+		std::lock_guard<std::mutex> lock( results_mut );
+		return WaitConditionLocked();
+	}
+
+	void AddObserver(detail::ChannelObserver *o)
+	{
+		std::lock_guard<std::mutex> lock( results_mut );
+		observers.Add( o );
+	}
+
+	void RemoveObserver(detail::ChannelObserver *o)
+	{
+		std::lock_guard<std::mutex> lock( results_mut );
+		observers.Remove( o );
 	}
 
 	size_t Count() const
@@ -106,11 +449,11 @@ struct ChannelImpl
 	{
 		std::unique_lock<std::mutex> lock( results_mut );
 
-		auto waitres = results_cond.wait_for( lock, dur, [=]() { return WaitConditionLocked(); } );
+		auto ready = results_cond.wait_for( lock, dur, [this]() { return WaitConditionLocked(); } );
 
-		return waitres == std::cv_status::timeout
-			? WaitStatus::Timeout
-			: WaitStatus::Ready;
+		return ready
+			? WaitStatus::Ready
+			: WaitStatus::Timeout;
 	}
 
 private:
@@ -118,6 +461,18 @@ private:
 	{
 		return results.size() || finished || canceled;
 	}
+
+	template<class OutIt>
+	std::size_t TakeLocked(OutIt out, std::size_t max)
+	{
+		auto n = std::min( max, results.size() );
+		auto last = results.begin() + n;
+
+		std::move( results.begin(), last, out );
+		results.erase( results.begin(), last );
+
+		return n;
+	}
 };
 
 template<>
@@ -127,7 +482,7 @@ struct ChannelImpl<void>
 
 	std::vector<char> results;
 	mutable std::mutex results_mut;
-	std::condition_variable results_cond;
+	mutable std::condition_variable results_cond;
 	std::atomic<bool> finished;
 	std::atomic<bool> canceled;
 
@@ -144,18 +499,24 @@ struct ChannelImpl<void>
 		return !( finished || canceled );
 	}
 
-	void Put(TaskResult<void>)
+	bool Put(TaskResult<void>)
 	{
 		std::lock_guard<std::mutex> lock( results_mut );
+
+		if ( !IsOpen() )
+			return false;
+
 		results.push_back( {} );
 
 		Ping();
+
+		return true;
 	}
 
 	result_type Get()
 	{
 		std::unique_lock<std::mutex> lock( results_mut );
-		results_cond.wait( lock, [=]() { return WaitConditionLocked(); } );
+		results_cond.wait( lock, [this]() { return WaitConditionLocked(); } );
 
 		if ( results.size() ) {
 			results.pop_back();
@@ -172,13 +533,21 @@ struct ChannelImpl<void>
 
 	void Cancel()
 	{
-		canceled = true;
+		{
+			std::lock_guard<std::mutex> lock( results_mut );
+			canceled = true;
+		}
+
 		Ping();
 	}
 
 	void Close()
 	{
-		finished = true;
+		{
+			std::lock_guard<std::mutex> lock( results_mut );
+			finished = true;
+		}
+
 		Ping();
 	}
 
@@ -186,7 +555,7 @@ struct ChannelImpl<void>
 	{
 		std::unique_lock<std::mutex> lock( results_mut );
 
-		results_cond.wait( lock, [=]() { return WaitConditionLocked(); } );
+		results_cond.wait( lock, [this]() { return WaitConditionLocked(); } );
 	}
 
 	template<class Rep, class Period>
@@ -194,11 +563,11 @@ struct ChannelImpl<void>
 	{
 		std::unique_lock<std::mutex> lock( results_mut );
 
-		auto waitres = results_cond.wait_for( lock, dur, [=]() { return WaitConditionLocked(); } );
+		auto ready = results_cond.wait_for( lock, dur, [this]() { return WaitConditionLocked(); } );
 
-		return waitres == std::cv_status::timeout
-			? WaitStatus::Timeout
-			: WaitStatus::Ready;
+		return ready
+			? WaitStatus::Ready
+			: WaitStatus::Timeout;
 	}
 
 private:
@@ -208,17 +577,37 @@ private:
 	}
 };
 
-template<class T>
+template<class T, class Impl = ChannelImpl<T>>
+class ChannelIterator;
+
+// Channel is a shared handle; Impl selects the queue implementation
+// at compile time (e.g. RingChannelImpl<T> from RingChannelImpl.hpp).
+// Its Put and Get operations are preemption points for coroutines, see
+// this_task::maybe_yield.
+template<class T, class Impl = ChannelImpl<T>>
 class Channel
 {
-	std::shared_ptr< ChannelImpl<T> > impl;
+	std::shared_ptr< Impl > impl;
 
 public:
-	typedef typename ChannelImpl<T>::result_type result_type;
+	typedef Impl impl_type;
+	typedef typename Impl::result_type result_type;
+	typedef ChannelIterator<T, Impl> iterator;
 
 public:
 	Channel()
-		: impl( std::make_shared< ChannelImpl<T> >() )
+		: impl( std::make_shared< Impl >() )
+	{}
+
+	// Forwards implementation specific settings, e.g. a capacity
+	template<class Arg, class... Args,
+	         typename = typename std::enable_if<
+		         !std::is_same< typename std::decay<Arg>::type, Channel >::value
+	                                           >::type
+	        >
+	explicit Channel(Arg&& arg, Args&&... args)
+		: impl( std::make_shared< Impl >( std::forward<Arg>(arg),
+		                                  std::forward<Args>(args)... ) )
 	{}
 
 	bool IsOpen() const
@@ -226,15 +615,108 @@ public:
 		return impl->IsOpen();
 	}
 
-	void Put(TaskResult<T> tfr)
+	// Returns false when the element was refused (channel closed)
+	bool Put(TaskResult<T> tfr)
 	{
-		impl->Put( std::move(tfr) );
+		auto accepted = impl->Put( std::move(tfr) );
+
+		this_task::maybe_yield();
+		return accepted;
 	}
 
 	result_type
 	Get()
 	{
-		return impl->Get();
+		auto res = impl->Get();
+
+		this_task::maybe_yield();
+		return res;
+	}
+
+	bool TryPut(TaskResult<T> tfr)
+	{
+		auto accepted = impl->TryPut( std::move(tfr) );
+
+		this_task::maybe_yield();
+		return accepted;
+	}
+
+	bool TryGet(result_type& out)
+	{
+		auto got = impl->TryGet( out );
+
+		this_task::maybe_yield();
+		return got;
+	}
+
+	// Transfers a whole range per synchronization; elements of an
+	// rvalue range are moved.  Returns how many were accepted, which
+	// is less than the range size only if the channel was closed.
+	template<class Range>
+	std::size_t PutMany(Range&& range)
+	{
+		auto n = PutManyImpl( range, std::is_lvalue_reference<Range>() );
+
+		this_task::maybe_yield();
+		return n;
+	}
+
+	// Blocks until at least one element is available (or the channel
+	// is closed) and writes up to max elements to out.  Returns the
+	// number received; 0 means the channel is closed and drained.
+	template<class OutIt>
+	std::size_t GetMany(OutIt out, std::size_t max)
+	{
+		auto n = impl->GetMany( out, max );
+
+		this_task::maybe_yield();
+		return n;
+	}
+
+	// As above, but gives up after dur; 0 may then also mean timeout
+	template<class OutIt, class Rep, class Period>
+	std::size_t GetMany(OutIt out, std::size_t max,
+	                    std::chrono::duration<Rep,Period> const& dur)
+	{
+		auto n = impl->GetMany( out, max, dur );
+
+		this_task::maybe_yield();
+		return n;
+	}
+
+	size_t Count() const
+	{
+		return impl->Count();
+	}
+
+	// True when Get would not block: an element is queued, or the
+	// channel was closed or canceled
+	bool Ready() const
+	{
+		return impl->Ready();
+	}
+
+	// Consumes the channel; see ChannelIterator
+	iterator begin(std::size_t batch = iterator::default_batch)
+	{
+		return iterator( impl, batch );
+	}
+
+	iterator end()
+	{
+		return iterator();
+	}
+
+	// Low level hook for select() and coroutine receivers; see
+	// detail::ChannelObserver
+	void AddObserver(detail::ChannelObserver *o)
+	{
+		impl->AddObserver( o );
+	}
+
+	void RemoveObserver(detail::ChannelObserver *o)
+	{
+		impl->RemoveObserver( o );
 	}
 
 	void Ping()
@@ -262,48 +744,121 @@ public:
 	{
 		return impl->WaitFor( dur );
 	}
+
+private:
+	template<class Range>
+	std::size_t PutManyImpl(Range& range, std::true_type)
+	{
+		return impl->PutMany( std::begin(range), std::end(range) );
+	}
+
+	template<class Range>
+	std::size_t PutManyImpl(Range& range, std::false_type)
+	{
+		return impl->PutMany( std::make_move_iterator( std::begin(range) ),
+		                      std::make_move_iterator( std::end(range) ) );
+	}
 };
 
-template<class T>
-struct ChannelIterator
+// Input iterator draining a Channel: elements are taken a batch at a
+// time with GetMany and handed out from a local buffer, so a plain
+// range-for costs one channel synchronization per batch.  The end is
+// reached once the channel is closed or canceled and drained.
+//
+//   for ( auto& v : channel )
+//       consume( std::move(v) );
+template<class T, class Impl>
+class ChannelIterator
 {
-	typedef typename ChannelImpl<T>::result_type result_type;
+public:
+	typedef std::input_iterator_tag iterator_category;
+	typedef T value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef T *pointer;
+	typedef T& reference;
+
+	static constexpr std::size_t default_batch = 64;
+
+private:
+	std::shared_ptr< Impl > channel;
+	std::vector< T > buffer;
+	std::size_t pos;
+	std::size_t batch;
+
+	void Fetch()
+	{
+		buffer.clear();
+		pos = 0;
+
+		if ( !channel->GetMany( std::back_inserter(buffer), batch ) )
+			channel.reset();
 
-	std::weak_ptr< ChannelImpl<T> > weak_channel;
+		this_task::maybe_yield();
+	}
 
+public:
+	// The end iterator
 	ChannelIterator()
-		: weak_channel()
+		: channel()
+		, buffer()
+		, pos(0)
+		, batch(0)
 	{}
 
-	ChannelIterator(std::shared_ptr< ChannelImpl<T> > channelimpl )
-		: weak_channel(channelimpl)
-	{}
+	explicit ChannelIterator(std::shared_ptr< Impl > channelimpl,
+	                         std::size_t batch_size = default_batch)
+		: channel( std::move(channelimpl) )
+		, buffer()
+		, pos(0)
+		, batch( batch_size ? batch_size : 1 )
+	{
+		buffer.reserve( batch );
+		Fetch();
+	}
 
-	result_type operator*()
+	T& operator*()
 	{
-		auto ch = weak_channel.lock();
-		if ( ch )
-			return ch->Get();
-		// TODO:
+		return buffer[pos];
 	}
 
-	void operator++()
-	{}
+	T *operator->()
+	{
+		return &buffer[pos];
+	}
+
+	ChannelIterator& operator++()
+	{
+		if ( ++pos == buffer.size() )
+			Fetch();
+
+		return *this;
+	}
 
 	void operator++(int)
-	{}
+	{
+		++*this;
+	}
+
+	// Iterators only differ in whether they reached the end
+	bool operator==(ChannelIterator const& other) const
+	{
+		return channel == other.channel;
+	}
 
 	bool operator!=(ChannelIterator const& other) const
 	{
-		return weak_channel != other.weak_channel;
+		return channel != other.channel;
 	}
 
 	explicit operator bool() const
 	{
-		return weak_channel;
+		return channel != nullptr;
 	}
 };
 
+template<class T, class Impl>
+constexpr std::size_t ChannelIterator<T, Impl>::default_batch;
+
 } // namespace as
 
 #endif // AS_CHANNEL_HPP
@@ -0,0 +1,542 @@
+//
+//  CoTask.hpp - C++20 stackless coroutine tasks on ThreadExecutor
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_CO_TASK_HPP
+#define AS_CO_TASK_HPP
+
+#if !defined(__cpp_impl_coroutine)
+#error "CoTask.hpp needs C++20 coroutines (e.g. -std=c++20)"
+#endif
+
+#include "ThreadExecutor.hpp"
+#include "TaskFuture.hpp"
+#include "Channel.hpp"
+#include "IntrusivePtr.hpp"
+#include "Optional.hpp"
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <type_traits>
+#include <utility>
+
+#include <cassert>
+
+namespace as {
+
+// Stackless alternative to the boost::context coroutines of Await.hpp:
+// a suspended as::task costs only its coroutine frame, typically a few
+// hundred bytes, instead of a whole stack.
+//
+// A task starts when it is awaited or spawned, and runs on the
+// executor it was spawned on (or that its awaiting task runs on) until
+// it hops with co_await ex.schedule().  Whatever it awaits resumes it
+// on that executor, never on the thread that completed the wait.
+//
+//   as::task<int> fetch(as::Channel<int>& requests)
+//   {
+//       auto r = co_await as::receive( requests );
+//       co_await worker_ex.schedule();
+//       co_return co_await as::async( io_ex, load, *r );
+//   }
+//
+//   as::TaskFuture<int> f = as::spawn( ex, fetch( requests ) );
+template<class T = void>
+class task;
+
+namespace detail {
+
+struct task_promise_base
+{
+	// The executor itself rather than the handle the task was spawned
+	// through, which need not outlive it
+	ThreadExecutorImpl *executor = nullptr;
+	std::coroutine_handle<> continuation;
+	std::exception_ptr error;
+
+	std::suspend_always initial_suspend() noexcept
+	{
+		return {};
+	}
+
+	// Hands the thread straight to whoever awaited the task
+	struct final_awaiter
+	{
+		bool await_ready() noexcept
+		{
+			return false;
+		}
+
+		template<class Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+		{
+			if ( auto c = h.promise().continuation )
+				return c;
+
+			return std::noop_coroutine();
+		}
+
+		void await_resume() noexcept
+		{}
+	};
+
+	final_awaiter final_suspend() noexcept
+	{
+		return {};
+	}
+
+	void unhandled_exception()
+	{
+		error = std::current_exception();
+	}
+};
+
+// Executor of the awaiting coroutine, if it is one of ours
+template<class Promise>
+ThreadExecutorImpl *executor_of(std::coroutine_handle<Promise> h)
+{
+	if constexpr ( std::is_base_of<task_promise_base, Promise>::value )
+		return h.promise().executor;
+	else
+		return nullptr;
+}
+
+// Work item that resumes a coroutine.  It lives in the frame of the
+// suspended coroutine, so no allocation is needed per resumption.  The
+// resume happens in Release, the last call the executor makes on a
+// work item: once resumed, the coroutine may finish and free the frame
+// holding this.
+class resume_work
+	: public ThreadWork
+{
+	std::coroutine_handle<> handle;
+
+public:
+	void Prepare(std::coroutine_handle<> h)
+	{
+		handle = h;
+	}
+
+	bool operator()()
+	{
+		return true;
+	}
+
+	void Release()
+	{
+		auto h = handle;
+		h.resume();
+	}
+
+	// Resumes on ex, or right here if there is no executor
+	void ResumeOn(ThreadExecutorImpl *ex)
+	{
+		if ( ex )
+			ex->ScheduleWork( this );
+		else
+			Release();
+	}
+};
+
+template<class T>
+struct task_promise
+	: task_promise_base
+{
+	Optional<T> value;
+
+	task<T> get_return_object();
+
+	template<class U>
+	void return_value(U&& v)
+	{
+		value.emplace( std::forward<U>(v) );
+	}
+
+	T result()
+	{
+		if ( error )
+			std::rethrow_exception( error );
+
+		return std::move( *value );
+	}
+};
+
+template<>
+struct task_promise<void>
+	: task_promise_base
+{
+	task<void> get_return_object();
+
+	void return_void()
+	{}
+
+	void result()
+	{
+		if ( error )
+			std::rethrow_exception( error );
+	}
+};
+
+class schedule_awaiter
+{
+	ThreadExecutorImpl *ex;
+	resume_work work;
+
+public:
+	explicit schedule_awaiter(ThreadExecutor& e)
+		: ex( e.Impl() )
+	{}
+
+	bool await_ready() const
+	{
+		return false;
+	}
+
+	template<class Promise>
+	void await_suspend(std::coroutine_handle<Promise> h)
+	{
+		if constexpr ( std::is_base_of<task_promise_base, Promise>::value )
+			h.promise().executor = ex;
+
+		work.Prepare( h );
+		ex->ScheduleWork( &work );
+	}
+
+	void await_resume() const
+	{}
+};
+
+template<class T>
+class future_awaiter
+	: public AsyncContinuation
+{
+	TaskFuture<T> fut;
+	ThreadExecutorImpl *ex;
+	resume_work work;
+	bool abandoned;
+
+public:
+	explicit future_awaiter(TaskFuture<T> f)
+		: fut( std::move(f) )
+		, ex(nullptr)
+		, work()
+		, abandoned(false)
+	{}
+
+	bool await_ready() const
+	{
+		return fut.ready();
+	}
+
+	// Nothing may touch the frame once the continuation is registered
+	template<class Promise>
+	void await_suspend(std::coroutine_handle<Promise> h)
+	{
+		ex = executor_of( h );
+		work.Prepare( h );
+
+		fut.add_continuation( this );
+	}
+
+	T await_resume()
+	{
+		if ( abandoned )
+			throw std::future_error( std::future_errc::broken_promise );
+
+		return fut.get();
+	}
+
+	void Dispatch()
+	{
+		work.ResumeOn( ex );
+	}
+
+	void Discard()
+	{
+		abandoned = true;
+		work.ResumeOn( ex );
+	}
+};
+
+// Receives one element; while the channel is empty the coroutine is
+// parked as an observer on it.  Notifications run under the channel's
+// lock, so they only queue the resume work; the work checks for an
+// element on the executor and registers again if another receiver got
+// there first, so a woken task always has a result.
+template<class T, class Impl>
+class receive_awaiter
+	: public ChannelObserver
+	, public ThreadWork
+{
+	typedef typename Channel<T, Impl>::result_type result_type;
+
+	Channel<T, Impl>& ch;
+	result_type out;
+	ThreadExecutorImpl *ex;
+	std::coroutine_handle<> handle;
+	bool fired;
+
+	bool TryTake()
+	{
+		if ( ch.TryGet( out ) )
+			return true;
+
+		// closed: whatever is left, or the empty end result
+		if ( !ch.IsOpen() ) {
+			out = ch.Get();
+			return true;
+		}
+
+		return false;
+	}
+
+	// Runs on the executor thread, so the resume it may queue cannot
+	// start before this returns
+	void Arm()
+	{
+		fired = false;
+		ch.AddObserver( this );
+
+		// Raced with a Put/Close before the registration took
+		if ( ch.Ready() ) {
+			ch.RemoveObserver( this );
+
+			if ( !fired ) {
+				fired = true;
+				ex->ScheduleWork( this );
+			}
+		}
+	}
+
+public:
+	explicit receive_awaiter(Channel<T, Impl>& c)
+		: ch(c)
+		, out()
+		, ex(nullptr)
+		, handle()
+		, fired(false)
+	{}
+
+	bool Notify()
+	{
+		if ( fired )
+			return false;
+
+		fired = true;
+		ex->ScheduleWork( this );
+
+		return true;
+	}
+
+	bool operator()()
+	{
+		return true;
+	}
+
+	void Release()
+	{
+		ch.RemoveObserver( this );
+
+		if ( !TryTake() ) {
+			Arm();
+			return;
+		}
+
+		auto h = handle;
+		h.resume();
+	}
+
+	bool await_ready()
+	{
+		return TryTake();
+	}
+
+	template<class Promise>
+	void await_suspend(std::coroutine_handle<Promise> h)
+	{
+		ex = executor_of( h );
+		handle = h;
+
+		assert( ex && "as::receive needs a task running on a ThreadExecutor" );
+
+		Arm();
+	}
+
+	result_type await_resume()
+	{
+		return std::move(out);
+	}
+};
+
+// Frame of a spawned task's driver; frees itself when done
+struct detached
+{
+	struct promise_type
+		: task_promise_base
+	{
+		detached get_return_object()
+		{
+			return {};
+		}
+
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void return_void()
+		{}
+	};
+};
+
+template<class T>
+detached drive(ThreadExecutor& ex, task<T> t, IntrusivePtr< AsyncResult<T> > r)
+{
+	co_await ex.schedule();
+
+	try {
+		if constexpr ( std::is_void<T>::value ) {
+			co_await std::move(t);
+			r->set();
+		} else {
+			r->set( co_await std::move(t) );
+		}
+	} catch (...) {
+		r->abandon();
+	}
+}
+
+} // namespace as::detail
+
+template<class T>
+class task
+{
+public:
+	typedef detail::task_promise<T> promise_type;
+
+private:
+	std::coroutine_handle<promise_type> handle;
+
+	friend promise_type;
+
+	explicit task(std::coroutine_handle<promise_type> h)
+		: handle(h)
+	{}
+
+public:
+	task(task&& other) noexcept
+		: handle( std::exchange( other.handle, nullptr ) )
+	{}
+
+	task& operator=(task&& other) noexcept
+	{
+		std::swap( handle, other.handle );
+		return *this;
+	}
+
+	task(task const&) = delete;
+	task& operator=(task const&) = delete;
+
+	~task()
+	{
+		if ( handle )
+			handle.destroy();
+	}
+
+	// Starts the task on the awaiting coroutine's executor and resumes
+	// the awaiting coroutine with its result once it finishes
+	class awaiter
+	{
+		std::coroutine_handle<promise_type> handle;
+
+	public:
+		explicit awaiter(std::coroutine_handle<promise_type> h)
+			: handle(h)
+		{}
+
+		bool await_ready() const
+		{
+			return !handle || handle.done();
+		}
+
+		template<class Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h)
+		{
+			handle.promise().executor = detail::executor_of( h );
+			handle.promise().continuation = h;
+
+			return handle;
+		}
+
+		T await_resume()
+		{
+			return handle.promise().result();
+		}
+	};
+
+	awaiter operator co_await() &&
+	{
+		return awaiter( handle );
+	}
+};
+
+namespace detail {
+
+template<class T>
+task<T> task_promise<T>::get_return_object()
+{
+	return task<T>( std::coroutine_handle< task_promise<T> >::from_promise( *this ) );
+}
+
+inline task<void> task_promise<void>::get_return_object()
+{
+	return task<void>( std::coroutine_handle< task_promise<void> >::from_promise( *this ) );
+}
+
+} // namespace as::detail
+
+inline detail::schedule_awaiter ThreadExecutor::schedule()
+{
+	return detail::schedule_awaiter( *this );
+}
+
+// Runs t on ex; the future is abandoned if t ends with an exception
+template<class T>
+TaskFuture<T> spawn(ThreadExecutor& ex, task<T> t)
+{
+	auto r = make_intrusive< AsyncResult<T> >();
+
+	detail::drive( ex, std::move(t), r );
+
+	return { std::move(r) };
+}
+
+template<class T>
+detail::future_awaiter<T> operator co_await(TaskFuture<T> fut)
+{
+	return detail::future_awaiter<T>( std::move(fut) );
+}
+
+// co_await as::receive( ch ) gives the next element, or an empty
+// result once the channel is closed and drained
+template<class T, class Impl>
+detail::receive_awaiter<T, Impl> receive(Channel<T, Impl>& ch)
+{
+	return detail::receive_awaiter<T, Impl>( ch );
+}
+
+} // namespace as
+
+#endif // AS_CO_TASK_HPP
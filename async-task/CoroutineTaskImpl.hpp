@@ -20,55 +20,14 @@
 #include <iostream>
 
 #include "TaskImpl.hpp"
+#include "ThisTask.hpp"
+#include "StackAllocator.hpp"
+#include "StackProfile.hpp"
 
 namespace as {
 
-class CoroutineTask
-{
-public:
-	virtual TaskStatus Invoke() = 0;
-	virtual void Yield() = 0;
-};
-
 namespace detail {
 
-// static thread_local std::vector< CoroutineTask * > this_task_stack{};
-
-struct coro_registry
-{
-	std::vector< CoroutineTask * > task_stack;
-
-	~coro_registry()
-	{
-		std::cout << "DESTROYING THE MANNER!\n";
-	}
-
-	static coro_registry& this_stack() {
-		static thread_local coro_registry instance{};
-		return instance;
-	}
-
-	void push(CoroutineTask *c)
-	{
-		task_stack.insert( std::begin(task_stack), c );
-	}
-
-	void pop()
-	{
-		task_stack.erase( std::begin(task_stack) );
-	}
-
-	CoroutineTask *top()
-	{
-		return task_stack[0];
-	}
-
-	size_t size() const
-	{
-		return task_stack.size();
-	}
-};
-
 template< std::size_t Max, std::size_t Default, std::size_t Min >
 class simple_stack_allocator
 {
@@ -217,8 +176,6 @@ struct BoostContext
 	{
 		static ctx::fcontext_t noreturn_ctx;
 
-		//Init();
-
 		Jump( &noreturn_ctx, &prev_ctxt, entry_arg );
 	}
 
@@ -235,11 +192,21 @@ struct BoostContext
 template<class TaskFunc>
 class CoroutineTaskPriv
 {
-	typedef detail::simple_stack_allocator<
+#ifdef AS_LAZY_COROUTINE_STACKS
+	// Every coroutine may grow to MAX_STACK_SIZE; memory is only
+	// committed as the stack is used
+	typedef detail::lazy_stack_allocator<
+		MAX_STACK_SIZE,
+		MAX_STACK_SIZE,
+		MIN_STACK_SIZE
+	                                    > stack_allocator;
+#else
+	typedef detail::pooled_stack_allocator<
 		MAX_STACK_SIZE,
 		DEFAULT_STACK_SIZE,
 		MIN_STACK_SIZE
 	                                      > stack_allocator;
+#endif
 
 	stack_allocator alloc;
 	std::size_t stack_size;
@@ -247,12 +214,16 @@ class CoroutineTaskPriv
 	v2::BoostContext bctxt;
 	invocation<TaskFunc> taskfunc;
 	bool running;
+	bool suspending;
 
 private:
 	void deinitialize_context()
 	{
 		// assert( stack );
 		if ( stack ) {
+#ifdef AS_PROFILE_COROUTINE_STACKS
+			detail::record_stack_use<TaskFunc>( stack, stack_size );
+#endif
 			alloc.deallocate( stack, stack_allocator::default_stacksize() );
 		}
 	}
@@ -267,7 +238,8 @@ private:
 
 		self->running = false;
 
-		self->bctxt.Init( self->stack, self->stack_size );
+		// a finished coroutine is never resumed again, so its
+		// context is left as it is instead of being rebuilt
 		self->bctxt.Exit();
 	}
 
@@ -284,7 +256,11 @@ public:
 		, bctxt( &CoroutineTaskPriv::entry_point,
 		         reinterpret_cast<intptr_t>(this) )
 		, running(false)
+		, suspending(false)
 	{
+#ifdef AS_PROFILE_COROUTINE_STACKS
+		detail::paint_stack( stack, stack_size );
+#endif
 		bctxt.Init( stack, stack_size );
 	}
 
@@ -296,7 +272,11 @@ public:
 		         reinterpret_cast<intptr_t>(this) )
 		, taskfunc( std::move(func) )
 		, running(false)
+		, suspending(false)
 	{
+#ifdef AS_PROFILE_COROUTINE_STACKS
+		detail::paint_stack( stack, stack_size );
+#endif
 		bctxt.Init( stack, stack_size );
 	}
 
@@ -313,6 +293,7 @@ public:
 		, bctxt( other.bctxt )
 		, taskfunc( std::move(other.taskfunc) )
 		, running( other.running )
+		, suspending( other.suspending )
 	{
 		if ( this == &other )
 			return;
@@ -326,6 +307,11 @@ public:
 	{
 		bctxt.Invoke();
 
+		if ( suspending ) {
+			suspending = false;
+			return TaskStatus::Suspended;
+		}
+
 		return running ? TaskStatus::Repeat : TaskStatus::Finished;
 	}
 
@@ -334,6 +320,12 @@ public:
 		bctxt.Yield();
 	}
 
+	void Suspend()
+	{
+		suspending = true;
+		bctxt.Yield();
+	}
+
 	void Cancel()
 	{}
 };
@@ -358,15 +350,11 @@ public:
 	{
 		assert( priv );
 
-		//detail::this_task_stack.insert( std::begin(detail::this_task_stack), this );
-
-		detail::coro_registry::this_stack().push( this );
+		detail::coro_registry::push( this );
 
 		auto r = priv->Invoke();
 
-		detail::coro_registry::this_stack().pop();
-
-		//detail::this_task_stack.erase( std::begin(detail::this_task_stack) );
+		detail::coro_registry::pop();
 
 		return r;
 	}
@@ -378,27 +366,17 @@ public:
 		priv->Yield();
 	}
 
+	void Suspend()
+	{
+		assert( priv );
+
+		priv->Suspend();
+	}
+
 	void Cancel()
 	{}
 };
 
-namespace this_task {
-
-inline void yield()
-{
-	// if ( detail::this_task_stack.size() == 0 )
-	// 	return;
-
-	if ( detail::coro_registry::this_stack().size() == 0 )
-		return;
-
-	detail::coro_registry::this_stack().top()->Yield();
-
-	//detail::this_task_stack[0]->Yield();
-}
-
-} // namespace as::ThisTask
-
 } // namespace as
 
 #endif // AS_COROUTINE_TASK_IMPL_HPP
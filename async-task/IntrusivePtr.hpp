@@ -0,0 +1,194 @@
+//
+//  IntrusivePtr.hpp - Intrusively reference counted objects and handles
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_INTRUSIVE_PTR_HPP
+#define AS_INTRUSIVE_PTR_HPP
+
+#include <atomic>
+#include <utility>
+
+#include <cassert>
+
+namespace as {
+
+// Base for objects whose reference count lives inside the object
+// itself; lets a single allocation hold both the count and the data
+class RefCounted
+{
+	mutable std::atomic<unsigned> refs;
+
+public:
+	RefCounted()
+		: refs(0)
+	{}
+
+	RefCounted(RefCounted const&)
+		: refs(0)
+	{}
+
+	RefCounted& operator=(RefCounted const&)
+	{
+		return *this;
+	}
+
+	virtual ~RefCounted() {}
+
+	void add_ref() const
+	{
+		refs.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	void release() const
+	{
+		// The sole owner can skip the atomic decrement; nobody else
+		// can take a new reference to the object concurrently
+		if ( refs.load( std::memory_order_acquire ) == 1 ||
+		     refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+			delete this;
+	}
+
+	unsigned use_count() const
+	{
+		return refs.load( std::memory_order_relaxed );
+	}
+
+protected:
+	// Seeds the count of an object that has not been shared yet, so
+	// several owners created together avoid one atomic increment each
+	void preset_refs(unsigned n) const
+	{
+		refs.store( n, std::memory_order_relaxed );
+	}
+};
+
+template<class T>
+class IntrusivePtr
+{
+	template<class U>
+	friend class IntrusivePtr;
+
+	T *ptr;
+
+public:
+	IntrusivePtr()
+		: ptr(nullptr)
+	{}
+
+	IntrusivePtr(std::nullptr_t)
+		: ptr(nullptr)
+	{}
+
+	explicit IntrusivePtr(T *p, bool add_ref = true)
+		: ptr(p)
+	{
+		if ( ptr && add_ref )
+			ptr->add_ref();
+	}
+
+	IntrusivePtr(IntrusivePtr const& other)
+		: ptr(other.ptr)
+	{
+		if ( ptr )
+			ptr->add_ref();
+	}
+
+	IntrusivePtr(IntrusivePtr&& other)
+		: ptr(other.ptr)
+	{
+		other.ptr = nullptr;
+	}
+
+	template<class U>
+	IntrusivePtr(IntrusivePtr<U> const& other)
+		: ptr(other.ptr)
+	{
+		if ( ptr )
+			ptr->add_ref();
+	}
+
+	template<class U>
+	IntrusivePtr(IntrusivePtr<U>&& other)
+		: ptr(other.ptr)
+	{
+		other.ptr = nullptr;
+	}
+
+	~IntrusivePtr()
+	{
+		if ( ptr )
+			ptr->release();
+	}
+
+	IntrusivePtr& operator=(IntrusivePtr other)
+	{
+		std::swap( ptr, other.ptr );
+		return *this;
+	}
+
+	void reset()
+	{
+		IntrusivePtr().swap( *this );
+	}
+
+	void swap(IntrusivePtr& other)
+	{
+		std::swap( ptr, other.ptr );
+	}
+
+	// Give up ownership without dropping the reference
+	T *detach()
+	{
+		T *p = ptr;
+		ptr = nullptr;
+		return p;
+	}
+
+	T *get() const
+	{
+		return ptr;
+	}
+
+	T& operator*() const
+	{
+		assert( ptr );
+		return *ptr;
+	}
+
+	T *operator->() const
+	{
+		assert( ptr );
+		return ptr;
+	}
+
+	explicit operator bool() const
+	{
+		return ptr != nullptr;
+	}
+
+	friend bool operator==(IntrusivePtr const& a, IntrusivePtr const& b)
+	{
+		return a.ptr == b.ptr;
+	}
+
+	friend bool operator!=(IntrusivePtr const& a, IntrusivePtr const& b)
+	{
+		return a.ptr != b.ptr;
+	}
+};
+
+template<class T, class... Args>
+IntrusivePtr<T> make_intrusive(Args&&... args)
+{
+	return IntrusivePtr<T>( new T( std::forward<Args>(args)... ) );
+}
+
+} // namespace as
+
+#endif // AS_INTRUSIVE_PTR_HPP
@@ -0,0 +1,161 @@
+//
+//  Optional.hpp - In-place storage for a value that may be absent
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_OPTIONAL_HPP
+#define AS_OPTIONAL_HPP
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <cassert>
+
+namespace as {
+
+// Minimal optional: the value lives in aligned storage inside the
+// object, so holding a result never costs a heap allocation
+template<class T>
+class Optional
+{
+	typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_type;
+
+	storage_type storage;
+	bool engaged;
+
+	T *ptr()
+	{
+		return reinterpret_cast<T *>( &storage );
+	}
+
+	const T *ptr() const
+	{
+		return reinterpret_cast<const T *>( &storage );
+	}
+
+public:
+	Optional()
+		: engaged(false)
+	{}
+
+	template<class U,
+	         typename = typename std::enable_if<
+		         std::is_constructible<T, U&&>::value &&
+		         !std::is_same<typename std::decay<U>::type, Optional>::value
+	                                           >::type
+	        >
+	Optional(U&& u)
+		: engaged(false)
+	{
+		emplace( std::forward<U>(u) );
+	}
+
+	Optional(Optional const& other)
+		: engaged(false)
+	{
+		if ( other.engaged )
+			emplace( *other );
+	}
+
+	Optional(Optional&& other)
+		noexcept( std::is_nothrow_move_constructible<T>::value )
+		: engaged(false)
+	{
+		if ( other.engaged )
+			emplace( std::move(*other) );
+	}
+
+	~Optional()
+	{
+		reset();
+	}
+
+	Optional& operator=(Optional const& other)
+	{
+		if ( this != &other ) {
+			reset();
+
+			if ( other.engaged )
+				emplace( *other );
+		}
+
+		return *this;
+	}
+
+	Optional& operator=(Optional&& other)
+		noexcept( std::is_nothrow_move_constructible<T>::value )
+	{
+		if ( this != &other ) {
+			reset();
+
+			if ( other.engaged )
+				emplace( std::move(*other) );
+		}
+
+		return *this;
+	}
+
+	template<class... Args>
+	T& emplace(Args&&... args)
+	{
+		reset();
+
+		new ( ptr() ) T( std::forward<Args>(args)... );
+		engaged = true;
+
+		return *ptr();
+	}
+
+	void reset()
+	{
+		if ( !engaged )
+			return;
+
+		engaged = false;
+		ptr()->~T();
+	}
+
+	bool has_value() const
+	{
+		return engaged;
+	}
+
+	explicit operator bool() const
+	{
+		return engaged;
+	}
+
+	T& operator*()
+	{
+		assert( engaged );
+		return *ptr();
+	}
+
+	const T& operator*() const
+	{
+		assert( engaged );
+		return *ptr();
+	}
+
+	T *operator->()
+	{
+		assert( engaged );
+		return ptr();
+	}
+
+	const T *operator->() const
+	{
+		assert( engaged );
+		return ptr();
+	}
+};
+
+} // namespace as
+
+#endif // AS_OPTIONAL_HPP
@@ -0,0 +1,382 @@
+//
+//  PriorityChannelImpl.hpp - Channel delivering the best element first
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_PRIORITY_CHANNEL_IMPL_HPP
+#define AS_PRIORITY_CHANNEL_IMPL_HPP
+
+#include "Channel.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+
+namespace as {
+
+// Unbounded channel whose Get returns the pending element that
+// compares greatest, like std::priority_queue: with std::greater on a
+// deadline, the earliest deadline comes out first.  Elements with
+// equal priority come out in no particular order.
+//
+// Elements sit in an implicit d-ary heap; with four children per node
+// a heap of a million elements is ten levels deep and the children
+// compared at each level are adjacent in memory, so Put and Get are
+// O(log n) with few cache misses.  PutMany rebuilds the heap in one
+// linear pass when the batch outnumbers what is already queued.
+//
+//   Channel< Job, PriorityChannelImpl<Job, ByDeadline> > jobs;
+template<class T, class Compare = std::less<T>, std::size_t Arity = 4>
+class PriorityChannelImpl
+{
+	static_assert( Arity >= 2, "PriorityChannelImpl needs at least two children per node" );
+
+public:
+	// An empty result means the channel was closed or canceled and
+	// nothing is left to receive
+	typedef Optional<T> result_type;
+
+private:
+	std::vector< T > heap;
+	Compare comp;
+	mutable std::mutex mut;
+	mutable std::condition_variable cond;
+	std::size_t sleepers;	// blocked receivers
+	std::size_t watchers;	// blocked in Wait/WaitFor
+	std::atomic<bool> finished;
+	std::atomic<bool> canceled;
+	detail::ChannelObserverList observers;
+
+public:
+	explicit PriorityChannelImpl(Compare c = Compare())
+		: heap()
+		, comp( std::move(c) )
+		, mut()
+		, cond()
+		, sleepers(0)
+		, watchers(0)
+		, finished(false)
+		, canceled(false)
+		, observers()
+	{}
+
+	bool IsOpen() const
+	{
+		return !( finished || canceled );
+	}
+
+	// False if the channel was closed; a result without a value has
+	// nothing to deliver and is dropped
+	bool Put(TaskResult<T>&& u)
+	{
+		if ( !u.ret )
+			return IsOpen();
+
+		{
+			std::lock_guard<std::mutex> lock( mut );
+
+			if ( !IsOpen() )
+				return false;
+
+			heap.push_back( std::move(*u.ret) );
+			SiftUp( heap.size() - 1 );
+
+			observers.Notify( 1 );
+
+			if ( watchers ) {
+				Ping();
+				return true;
+			}
+
+			if ( !sleepers )
+				return true;
+		}
+
+		cond.notify_one();
+		return true;
+	}
+
+	bool TryPut(TaskResult<T>&& u)
+	{
+		return Put( std::move(u) );
+	}
+
+	// Inserts [first, last) under a single lock acquisition
+	template<class It>
+	std::size_t PutMany(It first, It last)
+	{
+		std::size_t count;
+		bool wake;
+
+		{
+			std::lock_guard<std::mutex> lock( mut );
+
+			if ( !IsOpen() )
+				return 0;
+
+			auto before = heap.size();
+			heap.insert( heap.end(), first, last );
+			count = heap.size() - before;
+
+			// Sifting each one up costs O(count log n); rebuilding
+			// costs O(n), which wins once the batch dominates
+			if ( count > before ) {
+				Heapify();
+			} else {
+				for ( auto i = before; i < heap.size(); ++i )
+					SiftUp( i );
+			}
+
+			if ( count )
+				observers.Notify( count );
+
+			wake = count && ( sleepers || watchers );
+		}
+
+		if ( wake )
+			Ping();
+
+		return count;
+	}
+
+	result_type Get()
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		WaitLocked( lock );
+
+		result_type res;
+
+		if ( !heap.empty() )
+			res.emplace( PopLocked() );
+
+		return res;
+	}
+
+	bool TryGet(result_type& out)
+	{
+		std::lock_guard<std::mutex> lock( mut );
+
+		if ( heap.empty() )
+			return false;
+
+		out.emplace( PopLocked() );
+		return true;
+	}
+
+	// Waits for the first element, then takes up to max of the best
+	// elements, best first, under the same lock
+	template<class OutIt>
+	std::size_t GetMany(OutIt out, std::size_t max)
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		WaitLocked( lock );
+
+		return TakeLocked( out, max );
+	}
+
+	template<class OutIt, class Rep, class Period>
+	std::size_t GetMany(OutIt out, std::size_t max,
+	                    std::chrono::duration<Rep,Period> const& dur)
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		WaitForLocked( lock, dur );
+
+		return TakeLocked( out, max );
+	}
+
+	void Ping()
+	{
+		cond.notify_all();
+	}
+
+	void Cancel()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mut );
+			canceled = true;
+			observers.Notify();
+		}
+
+		Ping();
+	}
+
+	void Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mut );
+			finished = true;
+			observers.Notify();
+		}
+
+		Ping();
+	}
+
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		++watchers;
+		cond.wait( lock, [this]() { return WaitConditionLocked(); } );
+		--watchers;
+	}
+
+	template<class Rep, class Period>
+	WaitStatus WaitFor( std::chrono::duration<Rep,Period> const& dur )
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		++watchers;
+		auto ready = cond.wait_for( lock, dur, [this]() { return WaitConditionLocked(); } );
+		--watchers;
+
+		return ready
+			? WaitStatus::Ready
+			: WaitStatus::Timeout;
+	}
+
+	// True when Get would not block
+	bool Ready() const
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		return WaitConditionLocked();
+	}
+
+	void AddObserver(detail::ChannelObserver *o)
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		observers.Add( o );
+	}
+
+	void RemoveObserver(detail::ChannelObserver *o)
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		observers.Remove( o );
+	}
+
+	size_t Count() const
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		return heap.size();
+	}
+
+private:
+	bool WaitConditionLocked() const
+	{
+		return !heap.empty() || finished || canceled;
+	}
+
+	// A single element wakes a single receiver, unless someone in Wait
+	// has to hear about it too; nobody is notified while nobody sleeps
+	void WaitLocked(std::unique_lock<std::mutex>& lock)
+	{
+		++sleepers;
+		cond.wait( lock, [this]() { return WaitConditionLocked(); } );
+		--sleepers;
+	}
+
+	template<class Rep, class Period>
+	bool WaitForLocked(std::unique_lock<std::mutex>& lock,
+	                   std::chrono::duration<Rep,Period> const& dur)
+	{
+		++sleepers;
+		auto ready = cond.wait_for( lock, dur, [this]() { return WaitConditionLocked(); } );
+		--sleepers;
+
+		return ready;
+	}
+
+	template<class OutIt>
+	std::size_t TakeLocked(OutIt out, std::size_t max)
+	{
+		std::size_t n = 0;
+
+		for ( ; n < max && !heap.empty(); ++n, ++out )
+			*out = PopLocked();
+
+		return n;
+	}
+
+	// The heap operations move the displaced element into a hole
+	// instead of swapping at every level
+	void SiftUp(std::size_t i)
+	{
+		T v = std::move( heap[i] );
+
+		while( i > 0 ) {
+			auto parent = ( i - 1 ) / Arity;
+
+			if ( !comp( heap[parent], v ) )
+				break;
+
+			heap[i] = std::move( heap[parent] );
+			i = parent;
+		}
+
+		heap[i] = std::move(v);
+	}
+
+	void SiftDown(std::size_t i, T v)
+	{
+		auto n = heap.size();
+
+		for (;;) {
+			auto first = i * Arity + 1;
+
+			if ( first >= n )
+				break;
+
+			auto last = std::min( first + Arity, n );
+			auto best = first;
+
+			for ( auto c = first + 1; c < last; ++c )
+				if ( comp( heap[best], heap[c] ) )
+					best = c;
+
+			if ( !comp( v, heap[best] ) )
+				break;
+
+			heap[i] = std::move( heap[best] );
+			i = best;
+		}
+
+		heap[i] = std::move(v);
+	}
+
+	void Heapify()
+	{
+		if ( heap.size() < 2 )
+			return;
+
+		for ( auto i = ( heap.size() - 2 ) / Arity + 1; i-- > 0; )
+			SiftDown( i, std::move( heap[i] ) );
+	}
+
+	T PopLocked()
+	{
+		T top = std::move( heap.front() );
+		T last = std::move( heap.back() );
+
+		heap.pop_back();
+
+		if ( !heap.empty() )
+			SiftDown( 0, std::move(last) );
+
+		return top;
+	}
+};
+
+} // namespace as
+
+#endif // AS_PRIORITY_CHANNEL_IMPL_HPP
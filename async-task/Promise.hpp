@@ -0,0 +1,91 @@
+//
+//  Promise.hpp - Producer side of a TaskFuture completed by hand
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_PROMISE_HPP
+#define AS_PROMISE_HPP
+
+#include "AsyncResult.hpp"
+#include "TaskFuture.hpp"
+#include "IntrusivePtr.hpp"
+
+#include <future>
+#include <utility>
+
+namespace as {
+
+// Lets a result be produced outside of any executor, e.g. from a
+// third party callback thread; set_value() may be called from any
+// thread and directly dispatches the continuations registered with
+// TaskFuture::then() to their executors
+template<class T>
+class Promise
+{
+	IntrusivePtr< AsyncResult<T> > result;
+	bool future_retrieved;
+
+public:
+	Promise()
+		: result( make_intrusive< AsyncResult<T> >() )
+		, future_retrieved(false)
+	{}
+
+	Promise(Promise const&) = delete;
+	Promise& operator=(Promise const&) = delete;
+
+	Promise(Promise&& other)
+		: result( std::move(other.result) )
+		, future_retrieved( other.future_retrieved )
+	{}
+
+	Promise& operator=(Promise&& other)
+	{
+		Promise tmp( std::move(other) );
+		result.swap( tmp.result );
+		std::swap( future_retrieved, tmp.future_retrieved );
+
+		return *this;
+	}
+
+	// A promise dropped without a value abandons its future, whose
+	// get() then throws future_error(broken_promise)
+	~Promise()
+	{
+		if ( result && !result->ready() )
+			result->abandon();
+	}
+
+	// The result has a single consumer, so there is only one future
+	TaskFuture<T> get_future()
+	{
+		if ( future_retrieved )
+			throw std::future_error( std::future_errc::future_already_retrieved );
+
+		future_retrieved = true;
+
+		return { result };
+	}
+
+	// Must be called at most once
+	template<class... Args>
+	void set_value(Args&&... args)
+	{
+		result->set( std::forward<Args>(args)... );
+	}
+
+	// The consumer canceled the future; the producer may stop early
+	bool canceled() const
+	{
+		return result->canceled();
+	}
+};
+
+} // namespace as
+
+#endif // AS_PROMISE_HPP
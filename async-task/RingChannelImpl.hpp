@@ -0,0 +1,246 @@
+//
+//  RingChannelImpl.hpp - Bounded lock-free MPMC ring buffer Channel
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_RING_CHANNEL_IMPL_HPP
+#define AS_RING_CHANNEL_IMPL_HPP
+
+#include "BoundedChannel.hpp"
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+
+namespace as {
+
+// Bounded multi-producer/multi-consumer queue over a power-of-two
+// ring; each cell carries a sequence number telling producers and
+// consumers whose turn it is, so Put/Get only touch shared state with
+// a CAS on their position.  Threads block only when the ring is full
+// (Put) or empty (Get).
+//
+//   Channel< int, RingChannelImpl<int> > ch( 4096 );
+template<class T>
+class RingChannelImpl
+	: public detail::BoundedChannel< RingChannelImpl<T>, T >
+{
+	static_assert( !std::is_void<T>::value, "RingChannelImpl needs a value type" );
+
+	typedef detail::BoundedChannel< RingChannelImpl<T>, T > base_type;
+	friend base_type;
+
+public:
+	// Values are held inline; an empty result means the channel was
+	// closed or canceled and nothing is left to receive
+	typedef typename base_type::result_type result_type;
+
+	using base_type::default_capacity;
+
+private:
+	static constexpr std::size_t cache_line = 64;
+
+	struct Cell
+	{
+		std::atomic<std::size_t> seq;
+		Optional<T> value;
+	};
+
+	typedef std::atomic<std::size_t> position_type;
+
+	// Producer and consumer positions sit on their own cache lines
+	char pad0[cache_line];
+	position_type enqueue_pos;
+	char pad1[cache_line - sizeof(position_type)];
+	position_type dequeue_pos;
+	char pad2[cache_line - sizeof(position_type)];
+
+	std::unique_ptr<Cell[]> cells;
+	std::size_t mask;
+
+	// v is only moved from once a cell has been claimed
+	bool TryPush(T& v)
+	{
+		auto pos = enqueue_pos.load( std::memory_order_relaxed );
+		Cell *cell;
+
+		for (;;) {
+			cell = &cells[ pos & mask ];
+
+			auto seq = cell->seq.load( std::memory_order_acquire );
+			auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+			if ( diff == 0 ) {
+				if ( enqueue_pos.compare_exchange_weak( pos, pos + 1,
+				                                        std::memory_order_relaxed ) )
+					break;
+			} else if ( diff < 0 ) {
+				return false;
+			} else {
+				pos = enqueue_pos.load( std::memory_order_relaxed );
+			}
+		}
+
+		cell->value.emplace( std::move(v) );
+		cell->seq.store( pos + 1, std::memory_order_release );
+
+		return true;
+	}
+
+	bool TryPop(result_type& out)
+	{
+		auto pos = dequeue_pos.load( std::memory_order_relaxed );
+		Cell *cell;
+
+		for (;;) {
+			cell = &cells[ pos & mask ];
+
+			auto seq = cell->seq.load( std::memory_order_acquire );
+			auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+
+			if ( diff == 0 ) {
+				if ( dequeue_pos.compare_exchange_weak( pos, pos + 1,
+				                                        std::memory_order_relaxed ) )
+					break;
+			} else if ( diff < 0 ) {
+				return false;
+			} else {
+				pos = dequeue_pos.load( std::memory_order_relaxed );
+			}
+		}
+
+		out.emplace( std::move( *cell->value ) );
+		cell->value.reset();
+		cell->seq.store( pos + mask + 1, std::memory_order_release );
+
+		return true;
+	}
+
+	// Batch variants claim every consecutive free (or full) cell seen
+	// from the current position with a single CAS; a cell can only
+	// change state after its position has been claimed, so a
+	// successful CAS means all of them are still ours
+	template<class It>
+	std::size_t TryPushMany(It& first, std::size_t n)
+	{
+		auto pos = enqueue_pos.load( std::memory_order_relaxed );
+		std::size_t k;
+
+		for (;;) {
+			n = std::min( n, Capacity() );
+
+			for ( k = 0; k < n; ++k )
+				if ( cells[ (pos + k) & mask ].seq.load( std::memory_order_acquire ) != pos + k )
+					break;
+
+			if ( !k ) {
+				auto seq = cells[ pos & mask ].seq.load( std::memory_order_acquire );
+
+				if ( static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos) < 0 )
+					return 0;
+
+				pos = enqueue_pos.load( std::memory_order_relaxed );
+				continue;
+			}
+
+			if ( enqueue_pos.compare_exchange_weak( pos, pos + k,
+			                                        std::memory_order_relaxed ) )
+				break;
+		}
+
+		for ( std::size_t i = 0; i < k; ++i, ++first ) {
+			auto& cell = cells[ (pos + i) & mask ];
+
+			cell.value.emplace( *first );
+			cell.seq.store( pos + i + 1, std::memory_order_release );
+		}
+
+		return k;
+	}
+
+	template<class OutIt>
+	std::size_t TryPopMany(OutIt& out, std::size_t n)
+	{
+		auto pos = dequeue_pos.load( std::memory_order_relaxed );
+		std::size_t k;
+
+		for (;;) {
+			n = std::min( n, Capacity() );
+
+			for ( k = 0; k < n; ++k )
+				if ( cells[ (pos + k) & mask ].seq.load( std::memory_order_acquire ) != pos + k + 1 )
+					break;
+
+			if ( !k ) {
+				auto seq = cells[ pos & mask ].seq.load( std::memory_order_acquire );
+
+				if ( static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1) < 0 )
+					return 0;
+
+				pos = dequeue_pos.load( std::memory_order_relaxed );
+				continue;
+			}
+
+			if ( dequeue_pos.compare_exchange_weak( pos, pos + k,
+			                                        std::memory_order_relaxed ) )
+				break;
+		}
+
+		for ( std::size_t i = 0; i < k; ++i, ++out ) {
+			auto& cell = cells[ (pos + i) & mask ];
+
+			*out = std::move( *cell.value );
+			cell.value.reset();
+			cell.seq.store( pos + i + mask + 1, std::memory_order_release );
+		}
+
+		return k;
+	}
+
+	bool HasItem() const
+	{
+		auto pos = dequeue_pos.load( std::memory_order_acquire );
+		return cells[ pos & mask ].seq.load( std::memory_order_acquire ) == pos + 1;
+	}
+
+	bool HasRoom() const
+	{
+		auto pos = enqueue_pos.load( std::memory_order_acquire );
+		return cells[ pos & mask ].seq.load( std::memory_order_acquire ) == pos;
+	}
+
+public:
+	explicit RingChannelImpl(std::size_t capacity = default_capacity)
+		: enqueue_pos(0)
+		, dequeue_pos(0)
+		, cells( new Cell[ base_type::round_capacity(capacity) ] )
+		, mask( base_type::round_capacity(capacity) - 1 )
+	{
+		for ( std::size_t i = 0; i <= mask; ++i )
+			cells[i].seq.store( i, std::memory_order_relaxed );
+	}
+
+	std::size_t Capacity() const
+	{
+		return mask + 1;
+	}
+
+	// Approximate while producers/consumers are active
+	size_t Count() const
+	{
+		auto head = dequeue_pos.load( std::memory_order_acquire );
+		auto tail = enqueue_pos.load( std::memory_order_acquire );
+
+		return tail > head ? tail - head : 0;
+	}
+};
+
+} // namespace as
+
+#endif // AS_RING_CHANNEL_IMPL_HPP
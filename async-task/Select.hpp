@@ -0,0 +1,268 @@
+//
+//  Select.hpp - Wait for the first of several Channels/TaskFutures
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_SELECT_HPP
+#define AS_SELECT_HPP
+
+#include "Channel.hpp"
+#include "TaskFuture.hpp"
+#include "TaskImpl.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <tuple>
+
+namespace as {
+
+namespace detail {
+
+// The one thing a selecting thread sleeps on; every source holds a
+// small node pointing at it and signals it on any state change
+class SelectState
+	: public RefCounted
+{
+	std::mutex mut;
+	std::condition_variable cond;
+	bool signaled;
+
+public:
+	SelectState()
+		: signaled(false)
+	{}
+
+	void Signal()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+
+		signaled = true;
+		cond.notify_one();
+	}
+
+	// Consumes a signal; false if the deadline passed without one
+	bool WaitUntil(std::chrono::steady_clock::time_point const *deadline)
+	{
+		std::unique_lock<std::mutex> lock( mut );
+
+		if ( deadline ) {
+			if ( !cond.wait_until( lock, *deadline, [this]() { return signaled; } ) )
+				return false;
+		} else {
+			cond.wait( lock, [this]() { return signaled; } );
+		}
+
+		signaled = false;
+		return true;
+	}
+};
+
+// Channel observers are removed synchronously, so they live inside
+// the select call
+struct SelectChannelObserver
+	: public ChannelObserver
+{
+	SelectState *state;
+
+	explicit SelectChannelObserver(SelectState *s)
+		: state(s)
+	{}
+
+	bool Notify()
+	{
+		state->Signal();
+		return false;
+	}
+};
+
+// A future may already be dispatching its continuations when select
+// returns, so this node owns itself and keeps the state alive
+struct SelectFutureWaiter
+	: public AsyncContinuation
+{
+	IntrusivePtr<SelectState> state;
+
+	explicit SelectFutureWaiter(SelectState *s)
+		: state(s)
+	{}
+
+	void Dispatch()
+	{
+		state->Signal();
+		delete this;
+	}
+
+	void Discard()
+	{
+		state->Signal();
+		delete this;
+	}
+};
+
+template<class Source>
+struct select_source;
+
+template<class T, class Impl>
+struct select_source< Channel<T, Impl> >
+{
+	Channel<T, Impl>& ch;
+	SelectChannelObserver node;
+
+	select_source(Channel<T, Impl>& c, SelectState *state)
+		: ch(c)
+		, node(state)
+	{}
+
+	bool Ready() const
+	{
+		return ch.Ready();
+	}
+
+	void Register()
+	{
+		ch.AddObserver( &node );
+	}
+
+	void Unregister()
+	{
+		ch.RemoveObserver( &node );
+	}
+};
+
+template<class T>
+struct select_source< TaskFuture<T> >
+{
+	TaskFuture<T>& fut;
+	SelectState *state;
+	SelectFutureWaiter *node;
+
+	select_source(TaskFuture<T>& f, SelectState *s)
+		: fut(f)
+		, state(s)
+		, node(nullptr)
+	{}
+
+	bool Ready() const
+	{
+		return fut.ready();
+	}
+
+	void Register()
+	{
+		node = new SelectFutureWaiter( state );
+		fut.add_continuation( node );
+	}
+
+	void Unregister()
+	{
+		if ( fut.remove_continuation( node ) )
+			delete node;
+	}
+};
+
+template<class... Sources>
+class selector
+{
+	IntrusivePtr<SelectState> state;
+	std::tuple< select_source<Sources>... > sources;
+
+	static constexpr std::size_t count = sizeof...(Sources);
+
+	template<std::size_t... Ids>
+	int FirstReady(indices<Ids...>) const
+	{
+		bool ready[] = { std::get<Ids>(sources).Ready()... };
+
+		for ( std::size_t i = 0; i < count; ++i )
+			if ( ready[i] )
+				return i;
+
+		return -1;
+	}
+
+	int FirstReady() const
+	{
+		return FirstReady( typename build_indices<count>::type{} );
+	}
+
+	template<std::size_t... Ids>
+	void Register(indices<Ids...>)
+	{
+		int expand[] = { 0, ( std::get<Ids>(sources).Register(), 0 )... };
+		(void)expand;
+	}
+
+	template<std::size_t... Ids>
+	void Unregister(indices<Ids...>)
+	{
+		int expand[] = { 0, ( std::get<Ids>(sources).Unregister(), 0 )... };
+		(void)expand;
+	}
+
+public:
+	explicit selector(Sources&... srcs)
+		: state( make_intrusive<SelectState>() )
+		, sources( select_source<Sources>( srcs, state.get() )... )
+	{}
+
+	int Run(std::chrono::steady_clock::time_point const *deadline)
+	{
+		int index = FirstReady();
+
+		if ( index >= 0 )
+			return index;
+
+		Register( typename build_indices<count>::type{} );
+
+		// Registered before checking again, so a change that raced
+		// with the first check is either seen here or signaled
+		while( ( index = FirstReady() ) < 0 ) {
+			if ( !state->WaitUntil( deadline ) )
+				break;
+		}
+
+		Unregister( typename build_indices<count>::type{} );
+
+		return index;
+	}
+};
+
+} // namespace as::detail
+
+// Blocks until one of the given Channels has something to Get (or was
+// closed) or one of the given TaskFutures is ready, and returns the
+// index of the first such source in argument order.  The calling
+// thread sleeps on a single wait object however many sources there
+// are.  Nothing is consumed: with several consumers on a channel,
+// another one may still take the element first.
+//
+//   switch( as::select( requests, control, shutdown_future ) ) { ... }
+template<class... Sources>
+int select(Sources&... sources)
+{
+	static_assert( sizeof...(Sources) > 0, "select needs at least one source" );
+
+	return detail::selector<Sources...>( sources... ).Run( nullptr );
+}
+
+// As select, but returns -1 if nothing became ready within dur
+template<class Rep, class Period, class... Sources>
+int select_for(std::chrono::duration<Rep,Period> const& dur, Sources&... sources)
+{
+	static_assert( sizeof...(Sources) > 0, "select_for needs at least one source" );
+
+	auto deadline = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>( dur );
+
+	return detail::selector<Sources...>( sources... ).Run( &deadline );
+}
+
+} // namespace as
+
+#endif // AS_SELECT_HPP
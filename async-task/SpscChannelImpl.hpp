@@ -0,0 +1,193 @@
+//
+//  SpscChannelImpl.hpp - Bounded single-producer/single-consumer Channel
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_SPSC_CHANNEL_IMPL_HPP
+#define AS_SPSC_CHANNEL_IMPL_HPP
+
+#include "BoundedChannel.hpp"
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+
+namespace as {
+
+// Ring for a channel between exactly two stages: one thread puts and
+// one thread gets (each side may change threads, but never runs
+// concurrently with itself).  Each side owns its index and keeps a
+// cached copy of the other side's, so a push or pop is wait-free and
+// normally touches no cache line written by the other thread.
+//
+//   Channel< int, SpscChannelImpl<int> > ch( 4096 );
+template<class T>
+class SpscChannelImpl
+	: public detail::BoundedChannel< SpscChannelImpl<T>, T >
+{
+	static_assert( !std::is_void<T>::value, "SpscChannelImpl needs a value type" );
+
+	typedef detail::BoundedChannel< SpscChannelImpl<T>, T > base_type;
+	friend base_type;
+
+public:
+	typedef typename base_type::result_type result_type;
+
+	using base_type::default_capacity;
+
+private:
+	static constexpr std::size_t cache_line = 64;
+
+	typedef std::atomic<std::size_t> position_type;
+
+	// Consumer side: its index and the producer index it last saw
+	char pad0[cache_line];
+	position_type head;
+	std::size_t cached_tail;
+	char pad1[cache_line - sizeof(position_type) - sizeof(std::size_t)];
+
+	// Producer side
+	position_type tail;
+	std::size_t cached_head;
+	char pad2[cache_line - sizeof(position_type) - sizeof(std::size_t)];
+
+	std::unique_ptr< Optional<T>[] > buffer;
+	std::size_t mask;
+
+	// Free cells as seen by the producer; only reloads head when the
+	// cached copy says the ring is full
+	std::size_t Room(std::size_t t)
+	{
+		if ( t - cached_head == Capacity() )
+			cached_head = head.load( std::memory_order_acquire );
+
+		return Capacity() - ( t - cached_head );
+	}
+
+	std::size_t Available(std::size_t h)
+	{
+		if ( h == cached_tail )
+			cached_tail = tail.load( std::memory_order_acquire );
+
+		return cached_tail - h;
+	}
+
+	bool TryPush(T& v)
+	{
+		auto t = tail.load( std::memory_order_relaxed );
+
+		if ( !Room( t ) )
+			return false;
+
+		buffer[ t & mask ].emplace( std::move(v) );
+		tail.store( t + 1, std::memory_order_release );
+
+		return true;
+	}
+
+	bool TryPop(result_type& out)
+	{
+		auto h = head.load( std::memory_order_relaxed );
+
+		if ( !Available( h ) )
+			return false;
+
+		auto& cell = buffer[ h & mask ];
+
+		out.emplace( std::move(*cell) );
+		cell.reset();
+		head.store( h + 1, std::memory_order_release );
+
+		return true;
+	}
+
+	template<class It>
+	std::size_t TryPushMany(It& first, std::size_t n)
+	{
+		auto t = tail.load( std::memory_order_relaxed );
+		auto k = std::min( n, Room( t ) );
+
+		// Refresh a stale view once before settling for a short batch
+		if ( k < n ) {
+			cached_head = head.load( std::memory_order_acquire );
+			k = std::min( n, Room( t ) );
+		}
+
+		for ( std::size_t i = 0; i < k; ++i, ++first )
+			buffer[ (t + i) & mask ].emplace( *first );
+
+		tail.store( t + k, std::memory_order_release );
+
+		return k;
+	}
+
+	template<class OutIt>
+	std::size_t TryPopMany(OutIt& out, std::size_t n)
+	{
+		auto h = head.load( std::memory_order_relaxed );
+		auto k = std::min( n, Available( h ) );
+
+		if ( k < n ) {
+			cached_tail = tail.load( std::memory_order_acquire );
+			k = std::min( n, cached_tail - h );
+		}
+
+		for ( std::size_t i = 0; i < k; ++i, ++out ) {
+			auto& cell = buffer[ (h + i) & mask ];
+
+			*out = std::move(*cell);
+			cell.reset();
+		}
+
+		head.store( h + k, std::memory_order_release );
+
+		return k;
+	}
+
+	// May be called from either side (or a third thread), so these
+	// read the shared indices rather than the cached copies
+	bool HasItem() const
+	{
+		return head.load( std::memory_order_acquire ) !=
+			tail.load( std::memory_order_acquire );
+	}
+
+	bool HasRoom() const
+	{
+		return Count() < Capacity();
+	}
+
+public:
+	explicit SpscChannelImpl(std::size_t capacity = default_capacity)
+		: head(0)
+		, cached_tail(0)
+		, tail(0)
+		, cached_head(0)
+		, buffer( new Optional<T>[ base_type::round_capacity(capacity) ] )
+		, mask( base_type::round_capacity(capacity) - 1 )
+	{}
+
+	std::size_t Capacity() const
+	{
+		return mask + 1;
+	}
+
+	// Approximate while the producer/consumer are active
+	size_t Count() const
+	{
+		auto h = head.load( std::memory_order_acquire );
+		auto t = tail.load( std::memory_order_acquire );
+
+		return t > h ? t - h : 0;
+	}
+};
+
+} // namespace as
+
+#endif // AS_SPSC_CHANNEL_IMPL_HPP
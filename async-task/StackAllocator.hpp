@@ -0,0 +1,273 @@
+//
+//  StackAllocator.hpp - Pooled, guard-paged coroutine stacks
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_STACK_ALLOCATOR_HPP
+#define AS_STACK_ALLOCATOR_HPP
+
+#include <boost/assert.hpp>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <algorithm>
+#include <new>
+
+namespace as {
+
+namespace detail {
+
+inline std::size_t page_size()
+{
+	static const std::size_t size = ::sysconf( _SC_PAGESIZE );
+	return size;
+}
+
+inline std::size_t round_to_pages(std::size_t size)
+{
+	auto page = page_size();
+	return ( size + page - 1 ) / page * page;
+}
+
+// Maps size bytes of stack with an inaccessible page below it, so
+// running off the end faults right away instead of scribbling over
+// whatever was mapped next.  Returns the top of the stack, which is
+// what boost::context expects.  A reserved stack is not charged
+// against the commit limit up front; like any anonymous mapping, its
+// pages only become resident once touched.
+inline void *map_stack(std::size_t size, bool reserve_only = false)
+{
+	auto guard = page_size();
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_STACK
+	flags |= MAP_STACK;
+#endif
+
+	if ( reserve_only )
+		flags |= MAP_NORESERVE;
+
+	void *limit = ::mmap( nullptr, size + guard, PROT_READ | PROT_WRITE, flags, -1, 0 );
+
+	if ( limit == MAP_FAILED )
+		throw std::bad_alloc();
+
+	if ( ::mprotect( limit, guard, PROT_NONE ) != 0 ) {
+		::munmap( limit, size + guard );
+		throw std::bad_alloc();
+	}
+
+	return static_cast< char * >( limit ) + guard + size;
+}
+
+inline void unmap_stack(void *vp, std::size_t size)
+{
+	auto guard = page_size();
+
+	::munmap( static_cast< char * >( vp ) - size - guard, size + guard );
+}
+
+// Per-thread cache of stacks released by finished coroutines.  Freed
+// stacks are linked through a node kept in their own top bytes, so
+// the cache allocates nothing; reuse skips mmap, the guard page setup
+// and the page faults of touching a fresh stack.  A stack may be
+// released on a different thread than the one it came from.
+class stack_pool
+{
+	struct node
+	{
+		node *next;
+		std::size_t size;
+		std::size_t charge;
+	};
+
+	node *head;
+	std::size_t cached_bytes;
+
+	static node *node_of(void *vp)
+	{
+		return static_cast< node * >( vp ) - 1;
+	}
+
+public:
+	// Beyond this many resident bytes, released stacks go straight
+	// back to the system
+	static constexpr std::size_t max_cached_bytes = 4 * 1024 * 1024;
+
+	stack_pool()
+		: head(nullptr)
+		, cached_bytes(0)
+	{}
+
+	stack_pool(stack_pool const&) = delete;
+	stack_pool& operator=(stack_pool const&) = delete;
+
+	~stack_pool()
+	{
+		while( head ) {
+			auto n = head;
+			head = n->next;
+
+			unmap_stack( n + 1, n->size );
+		}
+	}
+
+	static stack_pool& this_thread()
+	{
+		static thread_local stack_pool instance{};
+		return instance;
+	}
+
+	// A cached stack of exactly size bytes, or nullptr
+	void *take(std::size_t size)
+	{
+		for ( auto p = &head; *p; p = &(*p)->next ) {
+			auto n = *p;
+
+			if ( n->size == size ) {
+				*p = n->next;
+				cached_bytes -= n->charge;
+
+				return n + 1;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// False when the cache is full and the caller should unmap vp.
+	// charge is how much of the stack is still resident.
+	bool give(void *vp, std::size_t size, std::size_t charge)
+	{
+		if ( cached_bytes + charge > max_cached_bytes )
+			return false;
+
+		auto n = node_of( vp );
+
+		n->next = head;
+		n->size = size;
+		n->charge = charge;
+		head = n;
+		cached_bytes += charge;
+
+		return true;
+	}
+};
+
+// Same interface as simple_stack_allocator, backed by stack_pool.
+// Stacks are not cleared on reuse: a coroutine must not rely on the
+// contents of memory it has not written.
+template< std::size_t Max, std::size_t Default, std::size_t Min >
+class pooled_stack_allocator
+{
+public:
+	static std::size_t maximum_stacksize()
+	{ return Max; }
+
+	static std::size_t default_stacksize()
+	{ return Default; }
+
+	static std::size_t minimum_stacksize()
+	{ return Min; }
+
+	void *allocate( std::size_t size ) const
+	{
+		BOOST_ASSERT( minimum_stacksize() <= size );
+		BOOST_ASSERT( maximum_stacksize() >= size );
+
+		size = round_to_pages( size );
+
+		if ( auto vp = stack_pool::this_thread().take( size ) )
+			return vp;
+
+		return map_stack( size );
+	}
+
+	void deallocate( void * vp, std::size_t size ) const
+	{
+		BOOST_ASSERT( vp );
+		BOOST_ASSERT( minimum_stacksize() <= size );
+		BOOST_ASSERT( maximum_stacksize() >= size );
+
+		size = round_to_pages( size );
+
+		if ( !stack_pool::this_thread().give( vp, size, size ) )
+			unmap_stack( vp, size );
+	}
+};
+
+// For large stacks: each one reserves Default bytes of address space
+// but only the pages a coroutine actually touches become resident.
+// When a stack is released, all but its top hot_bytes are handed back
+// to the kernel with MADV_DONTNEED, so a deep call chain does not pin
+// memory for the next coroutine to use the stack.  Resident memory
+// follows real stack use, not the reservation.
+//
+// Every stack is two mappings (stack and guard page), so very many
+// live coroutines may need vm.max_map_count raised on Linux (65530 by
+// default, i.e. about 32k stacks).
+template< std::size_t Max, std::size_t Default, std::size_t Min >
+class lazy_stack_allocator
+{
+public:
+	// Left committed on release; the top of a stack is what every
+	// coroutine touches first
+	static constexpr std::size_t hot_bytes = 16 * 1024;
+
+	static std::size_t maximum_stacksize()
+	{ return Max; }
+
+	static std::size_t default_stacksize()
+	{ return Default; }
+
+	static std::size_t minimum_stacksize()
+	{ return Min; }
+
+	void *allocate( std::size_t size ) const
+	{
+		BOOST_ASSERT( minimum_stacksize() <= size );
+		BOOST_ASSERT( maximum_stacksize() >= size );
+
+		size = round_to_pages( size );
+
+		if ( auto vp = stack_pool::this_thread().take( size ) )
+			return vp;
+
+		return map_stack( size, true );
+	}
+
+	void deallocate( void * vp, std::size_t size ) const
+	{
+		BOOST_ASSERT( vp );
+		BOOST_ASSERT( minimum_stacksize() <= size );
+		BOOST_ASSERT( maximum_stacksize() >= size );
+
+		size = round_to_pages( size );
+
+		auto hot = std::min( round_to_pages( hot_bytes ), size );
+
+		if ( !stack_pool::this_thread().give( vp, size, hot ) ) {
+			unmap_stack( vp, size );
+			return;
+		}
+
+		if ( size > hot )
+			::madvise( static_cast< char * >( vp ) - size, size - hot, MADV_DONTNEED );
+	}
+};
+
+template< std::size_t Max, std::size_t Default, std::size_t Min >
+constexpr std::size_t lazy_stack_allocator<Max, Default, Min>::hot_bytes;
+
+} // namespace as::detail
+
+} // namespace as
+
+#endif // AS_STACK_ALLOCATOR_HPP
@@ -0,0 +1,210 @@
+//
+//  StackProfile.hpp - High-watermark profiling of coroutine stacks
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_STACK_PROFILE_HPP
+#define AS_STACK_PROFILE_HPP
+
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <algorithm>
+#include <typeinfo>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+namespace as {
+
+// Peak stack use of one coroutine function type
+struct StackUsage
+{
+	std::string function;
+	std::size_t stack_size;	// what each one was given
+	std::size_t peak;	// deepest any of them went
+	std::size_t average;
+	std::size_t runs;
+};
+
+// Stack use of every coroutine function type run so far.  Only filled
+// in when built with AS_PROFILE_COROUTINE_STACKS: every coroutine
+// stack is then painted with a pattern before use, and the part still
+// intact when the coroutine is released is what it never touched.
+//
+// Painting writes the whole stack, so it costs a pass over it per
+// coroutine and commits lazily allocated stacks in full.  Measure
+// with profiling on, size DEFAULT_STACK_SIZE from the peaks plus a
+// margin, and ship without it.
+//
+//   as::StackProfile::Get().Report( std::cerr );
+class StackProfile
+{
+public:
+	struct Entry
+	{
+		std::string function;
+		std::size_t stack_size;
+		std::atomic<std::size_t> peak;
+		std::atomic<std::size_t> total;
+		std::atomic<std::size_t> runs;
+
+		Entry(std::string f, std::size_t size)
+			: function( std::move(f) )
+			, stack_size(size)
+			, peak(0)
+			, total(0)
+			, runs(0)
+		{}
+
+		void Record(std::size_t used)
+		{
+			auto p = peak.load( std::memory_order_relaxed );
+
+			while( used > p &&
+			       !peak.compare_exchange_weak( p, used, std::memory_order_relaxed ) )
+				;
+
+			total.fetch_add( used, std::memory_order_relaxed );
+			runs.fetch_add( 1, std::memory_order_relaxed );
+		}
+	};
+
+private:
+	mutable std::mutex mut;
+	std::deque< Entry > entries;	// never moves an Entry
+
+	static std::string Demangle(char const *name)
+	{
+#if defined(__GNUG__)
+		int status = 0;
+		std::unique_ptr< char, void (*)(void *) > readable(
+			abi::__cxa_demangle( name, nullptr, nullptr, &status ), std::free );
+
+		if ( status == 0 && readable )
+			return readable.get();
+#endif
+		return name;
+	}
+
+public:
+	static StackProfile& Get()
+	{
+		static StackProfile instance;
+		return instance;
+	}
+
+	// Once per function type; the entry lives as long as the profile
+	Entry& Register(std::type_info const& type, std::size_t stack_size)
+	{
+		auto name = Demangle( type.name() );
+
+		std::lock_guard<std::mutex> lock( mut );
+
+		entries.emplace_back( std::move(name), stack_size );
+		return entries.back();
+	}
+
+	// Deepest first
+	std::vector< StackUsage > Snapshot() const
+	{
+		std::vector< StackUsage > usage;
+
+		{
+			std::lock_guard<std::mutex> lock( mut );
+
+			for ( auto& e : entries ) {
+				auto runs = e.runs.load( std::memory_order_relaxed );
+
+				if ( !runs )
+					continue;
+
+				usage.push_back( StackUsage{
+						e.function,
+						e.stack_size,
+						e.peak.load( std::memory_order_relaxed ),
+						e.total.load( std::memory_order_relaxed ) / runs,
+						runs } );
+			}
+		}
+
+		std::sort( usage.begin(), usage.end(),
+		           [](StackUsage const& a, StackUsage const& b) {
+			           return a.peak > b.peak;
+		           } );
+
+		return usage;
+	}
+
+	// Tab separated, one line per function type, with a header line
+	void Report(std::ostream& os) const
+	{
+		os << "peak\taverage\tstack\truns\tfunction\n";
+
+		for ( auto& u : Snapshot() )
+			os << u.peak << '\t' << u.average << '\t' << u.stack_size << '\t'
+			   << u.runs << '\t' << u.function << '\n';
+	}
+
+	void Reset()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+
+		for ( auto& e : entries ) {
+			e.peak = 0;
+			e.total = 0;
+			e.runs = 0;
+		}
+	}
+};
+
+namespace detail {
+
+constexpr std::uint64_t stack_paint = 0xdeadc0dedeadc0deULL;
+
+// vp is the top of the stack, as the stack allocators hand it out
+inline void paint_stack(void *vp, std::size_t size)
+{
+	auto first = reinterpret_cast< std::uint64_t * >( static_cast< char * >( vp ) - size );
+
+	std::fill( first, first + size / sizeof( std::uint64_t ), stack_paint );
+}
+
+// Bytes from the top of the stack down to the deepest one written
+inline std::size_t used_stack(void *vp, std::size_t size)
+{
+	auto first = reinterpret_cast< std::uint64_t const * >( static_cast< char * >( vp ) - size );
+	auto last = first + size / sizeof( std::uint64_t );
+
+	auto touched = std::find_if( first, last,
+	                             [](std::uint64_t w) { return w != stack_paint; } );
+
+	return static_cast< std::size_t >( last - touched ) * sizeof( std::uint64_t );
+}
+
+template<class TaskFunc>
+void record_stack_use(void *vp, std::size_t size)
+{
+	static auto& entry = StackProfile::Get().Register( typeid(TaskFunc), size );
+
+	entry.Record( used_stack( vp, size ) );
+}
+
+} // namespace as::detail
+
+} // namespace as
+
+#endif // AS_STACK_PROFILE_HPP
@@ -0,0 +1,280 @@
+//
+//  Stream.hpp - Pipeline stages connecting Channels through executors
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_STREAM_HPP
+#define AS_STREAM_HPP
+
+#include "Async.hpp"
+#include "Channel.hpp"
+#include "RingChannelImpl.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace as {
+
+// Each operator starts one stage on the given executor and returns the
+// channel it writes to.  A stage reads its input a batch at a time,
+// and its output is a bounded ring, so a stage that runs ahead blocks
+// in Put until the next one catches up: memory between two stages
+// never exceeds the capacity.  The output is closed once the input is
+// closed and drained; if the output is closed early, the stage closes
+// its input in turn, so the whole pipeline winds down.
+//
+// A stage keeps its executor busy until it finishes, so every stage
+// needs an executor of its own (e.g. one ThreadExecutor per stage).
+//
+//   auto lines  = as::stream::map( ex1, input, parse );
+//   auto valid  = as::stream::filter( ex2, lines, is_valid );
+//   auto chunks = as::stream::batch( ex3, valid, 100, std::chrono::milliseconds(5) );
+//
+//   for ( auto& chunk : chunks )
+//       store( chunk );
+namespace stream {
+
+template<class T>
+using channel = Channel< T, RingChannelImpl<T> >;
+
+constexpr std::size_t default_capacity = 1024;
+
+// Elements taken from the input per synchronization
+constexpr std::size_t default_batch = 64;
+
+namespace detail {
+
+template<class F, class T>
+using result_of_t = typename std::decay<
+	decltype( std::declval<F&>()( std::declval<T>() ) )
+	>::type;
+
+// Feeds batches of the input to body, which appends what it produces
+// to its second argument, until the input is drained or out closed
+template<class T, class Impl, class U, class Body>
+void pump(Channel<T, Impl>& in, channel<U>& out, std::size_t batch, Body& body)
+{
+	std::vector<T> items;
+	std::vector<U> results;
+
+	items.reserve( batch );
+
+	while( in.GetMany( std::back_inserter(items), batch ) ) {
+		body( items, results );
+
+		auto n = results.size();
+
+		if ( n && out.PutMany( std::move(results) ) < n ) {
+			in.Close();
+			return;
+		}
+
+		items.clear();
+		results.clear();
+	}
+}
+
+template<class Ex, class T, class Impl, class U, class Body>
+void start(Ex& ex, Channel<T, Impl> in, channel<U> out, std::size_t batch, Body body)
+{
+	post( ex, [in, out, batch, body]() mutable {
+			pump( in, out, batch, body );
+			out.Close();
+		} );
+}
+
+} // namespace as::stream::detail
+
+// f(T&&) -> U
+template<class Ex, class T, class Impl, class F,
+         class U = detail::result_of_t<F, T&&>>
+channel<U> map(Ex& ex, Channel<T, Impl> in, F f,
+               std::size_t capacity = default_capacity)
+{
+	channel<U> out( capacity );
+
+	detail::start( ex, std::move(in), out, default_batch,
+	               [f](std::vector<T>& items, std::vector<U>& results) mutable {
+		               for ( auto& v : items )
+			               results.push_back( f( std::move(v) ) );
+	               } );
+
+	return out;
+}
+
+// Keeps the elements for which pred(T const&) is true
+template<class Ex, class T, class Impl, class Pred>
+channel<T> filter(Ex& ex, Channel<T, Impl> in, Pred pred,
+                  std::size_t capacity = default_capacity)
+{
+	channel<T> out( capacity );
+
+	detail::start( ex, std::move(in), out, default_batch,
+	               [pred](std::vector<T>& items, std::vector<T>& results) mutable {
+		               for ( auto& v : items )
+			               if ( pred( static_cast<T const&>(v) ) )
+				               results.push_back( std::move(v) );
+	               } );
+
+	return out;
+}
+
+// f(T&&) returns a range; each of its elements is forwarded
+template<class Ex, class T, class Impl, class F,
+         class R = detail::result_of_t<F, T&&>,
+         class U = typename std::decay< decltype( *std::begin( std::declval<R&>() ) ) >::type>
+channel<U> flat_map(Ex& ex, Channel<T, Impl> in, F f,
+                    std::size_t capacity = default_capacity)
+{
+	channel<U> out( capacity );
+
+	detail::start( ex, std::move(in), out, default_batch,
+	               [f](std::vector<T>& items, std::vector<U>& results) mutable {
+		               for ( auto& v : items ) {
+			               auto r = f( std::move(v) );
+
+			               results.insert( results.end(),
+			                               std::make_move_iterator( std::begin(r) ),
+			                               std::make_move_iterator( std::end(r) ) );
+		               }
+	               } );
+
+	return out;
+}
+
+// Groups elements into vectors of size elements; a partial group is
+// sent once max_delay has passed since its first element arrived, and
+// whatever is left when the input closes is sent as a last group.
+template<class Ex, class T, class Impl, class Rep, class Period>
+channel< std::vector<T> > batch(Ex& ex, Channel<T, Impl> in, std::size_t size,
+                                std::chrono::duration<Rep,Period> max_delay,
+                                std::size_t capacity = default_capacity)
+{
+	typedef std::chrono::steady_clock clock;
+
+	channel< std::vector<T> > out( capacity );
+	auto delay = std::chrono::duration_cast<clock::duration>( max_delay );
+
+	size = size ? size : 1;
+
+	post( ex, [in, out, size, delay]() mutable {
+			for (;;) {
+				std::vector<T> group;
+				group.reserve( size );
+
+				// The clock only starts with the first element
+				if ( !in.GetMany( std::back_inserter(group), size ) )
+					break;
+
+				auto deadline = clock::now() + delay;
+
+				while( group.size() < size ) {
+					auto now = clock::now();
+
+					if ( now >= deadline )
+						break;
+
+					if ( !in.GetMany( std::back_inserter(group), size - group.size(),
+					                  deadline - now ) && !in.IsOpen() )
+						break;
+				}
+
+				if ( !out.Put( as::continuing( std::move(group) ) ) ) {
+					in.Close();
+					break;
+				}
+			}
+
+			out.Close();
+		} );
+
+	return out;
+}
+
+// Sliding window: once size elements have arrived, sends a copy of the
+// last size elements every step elements (step == size gives disjoint
+// windows).  A trailing partial window is not sent.
+template<class Ex, class T, class Impl>
+channel< std::vector<T> > window(Ex& ex, Channel<T, Impl> in, std::size_t size,
+                                 std::size_t step = 1,
+                                 std::size_t capacity = default_capacity)
+{
+	channel< std::vector<T> > out( capacity );
+
+	size = size ? size : 1;
+	step = step ? step : 1;
+
+	// The body lives as long as the stage, so it carries the window
+	// from one batch to the next
+	detail::start( ex, std::move(in), out, default_batch,
+	               [size, step, recent = std::deque<T>(), due = size]
+	               (std::vector<T>& items, std::vector< std::vector<T> >& results) mutable {
+		               for ( auto& v : items ) {
+			               if ( recent.size() == size )
+				               recent.pop_front();
+
+			               recent.push_back( std::move(v) );
+
+			               if ( !--due ) {
+				               results.emplace_back( recent.begin(), recent.end() );
+				               due = step;
+			               }
+		               }
+	               } );
+
+	return out;
+}
+
+// As map, but f runs on every executor in executors at once, one
+// element at a time each, so at most that many calls are in flight.
+// Results are sent in completion order, not input order.
+//
+//   std::vector< as::ThreadExecutor > workers( 4 );
+//   auto thumbs = as::stream::parallel_map( workers, images, make_thumbnail );
+template<class Executors, class T, class Impl, class F,
+         class U = detail::result_of_t<F, T&&>>
+channel<U> parallel_map(Executors& executors, Channel<T, Impl> in, F f,
+                        std::size_t capacity = default_capacity)
+{
+	channel<U> out( capacity );
+
+	auto remaining = std::make_shared< std::atomic<std::size_t> >(
+		std::distance( std::begin(executors), std::end(executors) ) );
+
+	if ( !*remaining ) {
+		out.Close();
+		return out;
+	}
+
+	for ( auto& ex : executors )
+		post( ex, [in, out, f, remaining]() mutable {
+				auto body = [&f](std::vector<T>& items, std::vector<U>& results) {
+					for ( auto& v : items )
+						results.push_back( f( std::move(v) ) );
+				};
+
+				detail::pump( in, out, 1, body );
+
+				if ( remaining->fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+					out.Close();
+			} );
+
+	return out;
+}
+
+} // namespace as::stream
+
+} // namespace as
+
+#endif // AS_STREAM_HPP
@@ -12,26 +12,42 @@
 #define AS_TASK_FUTURE_HPP
 
 #include "AsyncResult.hpp"
+#include "IntrusivePtr.hpp"
+#include "CallableTraits.hpp"
 
 #include <memory>
 #include <atomic>
 
 namespace as {
 
+template<class T, class Func>
+struct ContinuationResultOf
+	: CallableResult< std::tuple<T>, typename std::decay<Func>::type >
+{};
+
+// Move-only, like std::future: the value is handed to whoever calls
+// get() or then() first, and asking again throws future_error
 template<class T>
 class TaskFuture
 {
-	std::shared_ptr< AsyncResult<T> > result;
+	IntrusivePtr< AsyncResult<T> > result;
 
 public:
 	TaskFuture() = default;
 
-	TaskFuture(std::shared_ptr<AsyncResult<T>> r)
+	TaskFuture(IntrusivePtr<AsyncResult<T>> r)
 		: result(std::move(r))
 	{}
 
+	TaskFuture(TaskFuture const&) = delete;
+	TaskFuture& operator=(TaskFuture const&) = delete;
+
+	TaskFuture(TaskFuture&&) = default;
+	TaskFuture& operator=(TaskFuture&&) = default;
+
 	T get()
 	{
+		result->claim();
 		return result->get();
 	}
 
@@ -44,6 +60,34 @@ public:
 	{
 		return result->ready();
 	}
+
+	// Low level hook for combinators; c is notified once, when the
+	// value is set or can no longer be set
+	void add_continuation(AsyncContinuation *c)
+	{
+		result->add_continuation( c );
+	}
+
+	bool remove_continuation(AsyncContinuation *c)
+	{
+		return result->remove_continuation( c );
+	}
+
+	// For combinators that keep a result alive without consuming it
+	IntrusivePtr< AsyncResult<T> > const& shared_result() const
+	{
+		return result;
+	}
+
+	// Run func with the value on ex once it is available, without
+	// blocking; defined in Async.hpp
+	template<class Ex, class Func>
+	TaskFuture< typename ContinuationResultOf<T, Func>::type >
+	then(Ex& ex, Func&& func);
+
+	template<class Func>
+	TaskFuture< typename ContinuationResultOf<T, Func>::type >
+	then(Func&& func);
 };
 
 } // namespace as
@@ -14,6 +14,7 @@
 #include "TaskStatus.hpp"
 #include "CallableTraits.hpp"
 #include "AsyncResult.hpp"
+#include "IntrusivePtr.hpp"
 
 #include <memory>
 #include <functional>
@@ -87,32 +88,26 @@ struct PostTask
 	{}
 };
 
-template<class Ret, class Func>
+// Handle used to hand a fused async control block (task functor,
+// result storage and refcount in one allocation) to executors that
+// can only accept a Task; the handle itself is a single pointer
+template<class Block>
 struct AsyncTask
 {
-	typedef Func function_type;
+	IntrusivePtr<Block> block;
 
-	Func func;
-	std::shared_ptr<AsyncResult<Ret>> result;
-
-	AsyncTask(Func func, std::shared_ptr<AsyncResult<Ret>> r)
-		: func( std::move(func) )
-		, result(r)
+	explicit AsyncTask(IntrusivePtr<Block> b)
+		: block( std::move(b) )
 	{}
 
 	TaskStatus Invoke()
 	{
-		if ( result->canceled() )
-			return TaskStatus::Canceled;
-
-		func();
-
-		return TaskStatus::Finished;
+		return block->Run();
 	}
 
 	void Cancel()
 	{
-		result->cancel();
+		block->cancel();
 	}
 };
 
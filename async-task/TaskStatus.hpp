@@ -15,6 +15,8 @@
 #include <type_traits>
 #include <future>
 
+#include "Optional.hpp"
+
 namespace as {
 
 enum WaitStatus {
@@ -27,7 +29,8 @@ enum class TaskStatus {
 	Finished,
 	Repeat,
 	Continuing,
-	Canceled
+	Canceled,
+	Suspended	// parked until woken; executors that cannot park treat it as Repeat
 };
 
 template<class T>
@@ -60,7 +63,7 @@ template<class T>
 struct TaskResult
 {
 	TaskStatus status;
-	std::unique_ptr<T> ret;
+	Optional<T> ret;
 
 	TaskResult()
 		: status()
@@ -74,12 +77,12 @@ struct TaskResult
 
 	TaskResult(TaskStatus s, T val)
 		: status(s)
-		, ret( new T{ val } )
+		, ret( std::move(val) )
 	{}
 
 	explicit TaskResult(T val)
 		: status()
-		, ret( new T{ val } )
+		, ret( std::move(val) )
 	{}
 
 	TaskResult(TaskResult<void> const& other)
@@ -0,0 +1,385 @@
+//
+//  ThisTask.hpp - The running coroutine: this_task and coroutine_local
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_THIS_TASK_HPP
+#define AS_THIS_TASK_HPP
+
+#include "TaskStatus.hpp"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+namespace as {
+
+// Reschedules a coroutine parked with this_task::suspend().  Provided
+// by executors that can park coroutines instead of re-running them.
+class TaskWaker
+{
+public:
+	// Announces a suspend; exactly one Wake() must follow, which may
+	// come before the coroutine has actually parked
+	virtual void Arm() = 0;
+	virtual void Wake() = 0;
+
+	// Wake(), but not before deadline
+	virtual void WakeAt(std::chrono::steady_clock::time_point deadline) = 0;
+
+protected:
+	~TaskWaker() {}
+};
+
+namespace detail {
+
+struct coro_registry;
+
+// Values of coroutine_local variables, indexed by the variable's slot;
+// each one is created on first use and lives as long as the table
+class local_slots
+{
+	struct slot
+	{
+		void *value;
+		void (*destroy)(void *);
+	};
+
+	std::vector< slot > slots;
+
+public:
+	local_slots()
+		: slots()
+	{}
+
+	local_slots(local_slots&&) = default;
+	local_slots& operator=(local_slots&&) = delete;
+	local_slots(local_slots const&) = delete;
+	local_slots& operator=(local_slots const&) = delete;
+
+	~local_slots()
+	{
+		for ( auto it = slots.rbegin(); it != slots.rend(); ++it )
+			if ( it->value )
+				it->destroy( it->value );
+	}
+
+	// Slots are never reused, so there are as many as variables
+	static std::size_t new_index()
+	{
+		static std::atomic< std::size_t > next{0};
+		return next.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	// For code not running in a coroutine
+	static local_slots& this_thread()
+	{
+		static thread_local local_slots instance{};
+		return instance;
+	}
+
+	template<class T>
+	T& get(std::size_t index)
+	{
+		if ( index >= slots.size() )
+			slots.resize( index + 1, slot{ nullptr, nullptr } );
+
+		auto& s = slots[index];
+
+		if ( !s.value ) {
+			s.value = new T();
+			s.destroy = [](void *vp) { delete static_cast< T * >( vp ); };
+		}
+
+		return *static_cast< T * >( s.value );
+	}
+};
+
+} // namespace as::detail
+
+class CoroutineTask
+{
+	typedef std::chrono::steady_clock Clock;
+
+	TaskWaker *waker;
+	CoroutineTask *outer;	// the one this runs within, on this thread
+	detail::local_slots locals;
+
+	// Time slice of the current run; see this_task::maybe_yield
+	Clock::time_point slice_start;	// when it was resumed
+	unsigned slice_checks;
+
+	friend struct detail::coro_registry;
+
+public:
+	// The clock is read on every this many checks only
+	static constexpr unsigned clock_interval = 16;
+
+	CoroutineTask()
+		: waker(nullptr)
+		, outer(nullptr)
+		, locals()
+		, slice_start()
+		, slice_checks(0)
+	{}
+
+	virtual TaskStatus Invoke() = 0;
+	virtual void Yield() = 0;
+
+	// Like Yield, but Invoke reports TaskStatus::Suspended
+	virtual void Suspend() = 0;
+
+	void SetWaker(TaskWaker *w)
+	{
+		waker = w;
+	}
+
+	TaskWaker *Waker() const
+	{
+		return waker;
+	}
+
+	detail::local_slots& Locals()
+	{
+		return locals;
+	}
+
+	// True once this run has lasted slice since it was resumed
+	bool SliceUsed(std::chrono::nanoseconds slice)
+	{
+		if ( ++slice_checks % clock_interval )
+			return false;
+
+		return Clock::now() - slice_start >= slice;
+	}
+};
+
+namespace detail {
+
+// In nanoseconds; 0 turns this_task::maybe_yield off
+inline std::atomic< std::int64_t >& time_slice_ns()
+{
+	static std::atomic< std::int64_t > slice{0};
+	return slice;
+}
+
+// Coroutines running on this thread, innermost on top, linked through
+// the tasks themselves.  Pushed and popped around every resume, so it
+// is a constant-initialized pointer: no allocation, no guard on the
+// thread_local, O(1) either way.
+struct coro_registry
+{
+	static CoroutineTask *& current()
+	{
+		static thread_local CoroutineTask *top = nullptr;
+		return top;
+	}
+
+	static void push(CoroutineTask *c)
+	{
+		auto& top = current();
+
+		c->outer = top;
+		c->slice_checks = 0;
+
+		// only paid for while preemption is on
+		if ( time_slice_ns().load( std::memory_order_relaxed ) )
+			c->slice_start = CoroutineTask::Clock::now();
+
+		top = c;
+	}
+
+	static void pop()
+	{
+		auto& top = current();
+
+		top = top->outer;
+	}
+
+	// nullptr outside of any coroutine
+	static CoroutineTask *top()
+	{
+		return current();
+	}
+};
+
+} // namespace as::detail
+
+namespace this_task {
+
+inline void yield()
+{
+	auto top = detail::coro_registry::top();
+
+	if ( !top )
+		return;
+
+	top->Yield();
+}
+
+// Waker of the running coroutine, or nullptr when it cannot be parked
+// (not in a coroutine, or its executor only knows how to re-run it)
+inline TaskWaker *waker()
+{
+	auto top = detail::coro_registry::top();
+
+	if ( !top )
+		return nullptr;
+
+	return top->Waker();
+}
+
+// Parks the running coroutine until its waker's Wake(); the caller
+// must have called Arm() and handed the waker to whoever wakes it
+inline void suspend()
+{
+	auto top = detail::coro_registry::top();
+
+	if ( !top )
+		return;
+
+	top->Suspend();
+}
+
+// Cooperative preemption: a coroutine that has run for longer than
+// the time slice since it was last resumed yields at its next
+// maybe_yield().  Channel operations check, so do the stream
+// operators through them; long loops of your own should call
+// maybe_yield() as well.  Off (zero) by default, since a coroutine may
+// then yield at any of those points: do not hold a std::mutex across
+// them that other coroutines on the same thread might need (an
+// AsyncMutex is fine).
+template<class Rep, class Period>
+void set_time_slice(std::chrono::duration<Rep, Period> const& slice)
+{
+	detail::time_slice_ns().store(
+		std::chrono::duration_cast< std::chrono::nanoseconds >( slice ).count(),
+		std::memory_order_relaxed );
+}
+
+inline std::chrono::nanoseconds time_slice()
+{
+	return std::chrono::nanoseconds(
+		detail::time_slice_ns().load( std::memory_order_relaxed ) );
+}
+
+// Yields if the running coroutine has used up its time slice.  Costs
+// a thread_local and an atomic load when preemption is off or outside
+// of coroutines, and reads the clock on every
+// CoroutineTask::clock_interval calls otherwise.
+inline void maybe_yield()
+{
+	auto top = detail::coro_registry::top();
+
+	if ( !top )
+		return;
+
+	auto slice = time_slice();
+
+	if ( slice.count() && top->SliceUsed( slice ) )
+		top->Yield();
+}
+
+// Suspends the running coroutine until deadline; it costs no thread
+// time meanwhile, only the executor's timer entry.  Where a coroutine
+// cannot be parked this keeps yielding to the other coroutines until
+// then, and outside of one it is std::this_thread::sleep_until.
+template<class Clock, class Duration>
+void sleep_until(std::chrono::time_point<Clock, Duration> const& deadline)
+{
+	typedef std::chrono::steady_clock steady;
+
+	if ( !detail::coro_registry::top() ) {
+		std::this_thread::sleep_until( deadline );
+		return;
+	}
+
+	if ( auto w = waker() ) {
+		auto at = steady::now()
+			+ std::chrono::duration_cast< steady::duration >( deadline - Clock::now() );
+
+		w->Arm();
+		w->WakeAt( at );
+
+		suspend();
+		return;
+	}
+
+	while( Clock::now() < deadline ) {
+		yield();
+		std::this_thread::sleep_for( std::chrono::microseconds(1) );
+	}
+}
+
+template<class Rep, class Period>
+void sleep_for(std::chrono::duration<Rep, Period> const& dur)
+{
+	sleep_until( std::chrono::steady_clock::now() + dur );
+}
+
+} // namespace as::ThisTask
+
+// Like a thread_local variable, but every coroutine has its own value,
+// created (default constructed) the first time that coroutine uses it
+// and destroyed with the coroutine.  Code outside of a coroutine gets
+// a per-thread value.  Coroutines interleaving on one thread each see
+// their own, so per-request context need not be passed down through
+// every call:
+//
+//   static as::coroutine_local< std::string > trace_id;
+//
+//   as::await( ex, [&]() {
+//       *trace_id = request.id;
+//       handle( request );     // reads *trace_id wherever it logs
+//   } );
+//
+// Each variable takes a slot in every coroutine that uses it, so
+// declare them static, as you would a thread_local.
+template<class T>
+class coroutine_local
+{
+	std::size_t index;
+
+	detail::local_slots& Slots() const
+	{
+		auto top = detail::coro_registry::top();
+
+		return top
+			? top->Locals()
+			: detail::local_slots::this_thread();
+	}
+
+public:
+	coroutine_local()
+		: index( detail::local_slots::new_index() )
+	{}
+
+	coroutine_local(coroutine_local const&) = delete;
+	coroutine_local& operator=(coroutine_local const&) = delete;
+
+	T& get() const
+	{
+		return Slots().template get<T>( index );
+	}
+
+	T& operator*() const
+	{
+		return get();
+	}
+
+	T *operator->() const
+	{
+		return &get();
+	}
+};
+
+} // namespace as
+
+#endif // AS_THIS_TASK_HPP
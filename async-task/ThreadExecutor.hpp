@@ -23,12 +23,20 @@
 #include <chrono>
 #include <algorithm>
 #include <deque>
+#include <vector>
 #include <type_traits>
+#include <cstdint>
 
 #include <cassert>
 
 namespace as {
 
+#if defined(__cpp_impl_coroutine)
+namespace detail {
+class schedule_awaiter;
+} // namespace as::detail
+#endif
+
 struct ThreadWork
 {
 	ThreadWork *next;
@@ -39,8 +47,32 @@ struct ThreadWork
 
 	virtual ~ThreadWork() {}
 	virtual bool operator()() = 0;
+
+	// Called by the executor once the work is finished; work items
+	// that share their allocation with other owners override this
+	virtual void Release()
+	{
+		delete this;
+	}
+
+	// Called instead of running the work when the executor is
+	// destroyed before it got to it
+	virtual void Discard()
+	{
+		Release();
+	}
 };
 
+struct ThreadWorkReleaser
+{
+	void operator()(ThreadWork *work) const
+	{
+		work->Release();
+	}
+};
+
+typedef std::unique_ptr<ThreadWork, ThreadWorkReleaser> ThreadWorkPtr;
+
 template<class Func>
 struct ThreadWorkImpl
 	: public ThreadWork
@@ -69,10 +101,13 @@ struct ThreadWorkImpl
 
 class ThreadExecutorImpl
 {
-	typedef std::chrono::high_resolution_clock Clock;
+public:
+	typedef std::chrono::steady_clock Clock;
 	typedef std::chrono::time_point<Clock> TimePoint;
 	typedef std::chrono::milliseconds Interval;
 
+private:
+
 	template<class T>
 	struct JobQueue
 	{
@@ -199,10 +234,13 @@ class ThreadExecutorImpl
 			, ex(ex)
 		{}
 
+		// Takes over the shared queue and any timers that are due
 		bool StealWork()
 		{
+			bool due = ex->ExpireTimers( priv_task_queue );
+
 			if ( ex->task_queue.Empty() )
-				return false;
+				return due;
 
 			while( auto job = ex->task_queue.Pop() )
 				priv_task_queue.Push( job );
@@ -211,7 +249,27 @@ class ThreadExecutorImpl
 		}
 	};
 
+	// Work waiting for a deadline; a binary heap with the earliest
+	// deadline on top, ties run in the order they were scheduled
+	struct Timer
+	{
+		TimePoint deadline;
+		std::uint64_t seq;
+		ThreadWork *work;
+
+		bool operator<(Timer const& other) const
+		{
+			if ( deadline != other.deadline )
+				return deadline > other.deadline;
+
+			return seq > other.seq;
+		}
+	};
+
 	IntrusiveJobQueue<ThreadWork> task_queue;
+	std::vector<Timer> timers;
+	std::uint64_t timer_seq;
+	bool timers_changed;	// a new earliest deadline to wait for
 	std::mutex task_mut;
 	std::condition_variable cond;
 	std::atomic<bool> quit_requested;
@@ -220,6 +278,9 @@ class ThreadExecutorImpl
 public:
 	ThreadExecutorImpl()
 		: task_queue()
+		, timers()
+		, timer_seq(0)
+		, timers_changed(false)
 		, task_mut()
 		, cond()
 		, quit_requested(false)
@@ -231,6 +292,9 @@ public:
 
 	ThreadExecutorImpl(std::string)
 		: task_queue()
+		, timers()
+		, timer_seq(0)
+		, timers_changed(false)
 		, task_mut()
 		, cond()
 		, quit_requested(false)
@@ -249,13 +313,21 @@ public:
 			thr.join();
 
 		assert( task_queue.Empty() );
+
+		// Timers still pending never run
+		for ( auto& t : timers )
+			t.work->Discard();
 	}
 
 	template<class Handler>
 	void Schedule(Handler&& ti)
 	{
-		auto tw = new ThreadWorkImpl<Handler>{ std::forward<Handler>(ti) };
+		ScheduleWork( new ThreadWorkImpl<Handler>{ std::forward<Handler>(ti) } );
+	}
 
+	// Takes over one reference to tw; tw->Release() is called when done
+	void ScheduleWork(ThreadWork *tw)
+	{
 		if ( auto ctx = Registry<ThreadExecutorImpl, Context>::Current(this) ) {
 			ctx->priv_task_queue.Push( tw );
 			return;
@@ -273,6 +345,25 @@ public:
 
 	void ScheduleAfter(Task task, std::chrono::milliseconds time_ms)
 	{
+		ScheduleWorkAt( new ThreadWorkImpl<Task>{ std::move(task) },
+		                Clock::now() + time_ms );
+	}
+
+	// Like ScheduleWork, but tw is not run before deadline.  Waiting
+	// timers cost an entry in the heap each and no thread time.
+	void ScheduleWorkAt(ThreadWork *tw, TimePoint deadline)
+	{
+		std::lock_guard<std::mutex> lock{ task_mut };
+
+		timers.push_back( Timer{ deadline, timer_seq++, tw } );
+		std::push_heap( timers.begin(), timers.end() );
+
+		// the executor thread sleeps until the earliest deadline, so
+		// only a new earliest one needs to wake it up
+		if ( !IsCurrent() && timers.front().work == tw ) {
+			timers_changed = true;
+			cond.notify_one();
+		}
 	}
 
 	void Iteration()
@@ -296,19 +387,27 @@ public:
 		return Registry<ThreadExecutorImpl, Context>::Current(this) != nullptr;
 	}
 
+	// Runs until no work is left, sleeping through the gaps between
+	// pending timers
 	void Run()
 	{
 		Context ctx(this);
+		std::unique_lock<std::mutex> lock(task_mut);
 
-		for( std::unique_lock<std::mutex> lock(task_mut);
-		     ctx.StealWork() || !ctx.priv_task_queue.Empty();
-		     lock.lock() )
-		{
-			assert( lock.owns_lock() );
+		for (;;) {
+			if ( ctx.StealWork() || !ctx.priv_task_queue.Empty() ) {
+				lock.unlock();
 
-			lock.unlock();
+				DoIteration( &ctx );
 
-			DoIteration( &ctx );
+				lock.lock();
+				continue;
+			}
+
+			if ( timers.empty() )
+				break;
+
+			cond.wait_until( lock, timers.front().deadline );
 		}
 	}
 
@@ -332,10 +431,20 @@ private:
 		while( !quit_requested )
 		{
 			std::unique_lock<std::mutex> lock(task_mut);
-			cond.wait( lock,
-			           [&]() {
-				           return !ctx.priv_task_queue.Empty() || !task_queue.Empty() || quit_requested;
-			           } );
+
+			// a new earliest timer ends the wait too, and the next
+			// round waits for its deadline instead
+			auto ready = [&]() {
+				return !ctx.priv_task_queue.Empty() || !task_queue.Empty()
+					|| quit_requested || timers_changed;
+			};
+
+			if ( timers.empty() )
+				cond.wait( lock, ready );
+			else
+				cond.wait_until( lock, timers.front().deadline, ready );
+
+			timers_changed = false;
 
 			ctx.StealWork();
 
@@ -345,6 +454,28 @@ private:
 		}
 	}
 
+	// Moves the timers whose deadline has passed onto jobs; called
+	// with task_mut held
+	bool ExpireTimers(IntrusiveJobQueue<ThreadWork>& jobs)
+	{
+		if ( timers.empty() )
+			return false;
+
+		auto now = Clock::now();
+		bool due = false;
+
+		while( !timers.empty() && timers.front().deadline <= now ) {
+			std::pop_heap( timers.begin(), timers.end() );
+
+			jobs.Push( timers.back().work );
+			timers.pop_back();
+
+			due = true;
+		}
+
+		return due;
+	}
+
 	bool DoIteration(Context *ctx)
 	{
 		auto& jobs = ctx->priv_task_queue;
@@ -356,7 +487,7 @@ private:
 		auto job_count = jobs.Count();
 
 		while( job_count ) {
-			std::unique_ptr<ThreadWork> tip{ jobs.Pop() };
+			ThreadWorkPtr tip{ jobs.Pop() };
 
 			--job_count;
 
@@ -390,7 +521,7 @@ private:
 		auto job_count = jobs.Count();
 
 		while( job_count ) {
-			std::unique_ptr<ThreadWork> tip{ jobs.Pop() };
+			ThreadWorkPtr tip{ jobs.Pop() };
 
 			auto fin = DoProcessTask( tip.get() );
 
@@ -411,10 +542,12 @@ private:
 class ThreadExecutor
 	: public Executor
 {
-	typedef std::chrono::high_resolution_clock Clock;
-	typedef std::chrono::time_point<Clock> TimePoint;
-	typedef std::chrono::milliseconds Interval;
+public:
+	typedef ThreadExecutorImpl::Clock Clock;
+	typedef ThreadExecutorImpl::TimePoint TimePoint;
+	typedef ThreadExecutorImpl::Interval Interval;
 
+private:
 	std::shared_ptr<ThreadExecutorImpl> impl;
 
 public:
@@ -471,6 +604,29 @@ public:
 	{
 		impl->Schedule(std::forward<Handler>(ti));
 	}
+
+	void ScheduleWork(ThreadWork *work)
+	{
+		impl->ScheduleWork(work);
+	}
+
+	void ScheduleWorkAt(ThreadWork *work, TimePoint deadline)
+	{
+		impl->ScheduleWorkAt(work, deadline);
+	}
+
+	// The executor this handle refers to; it stays valid for as long
+	// as any handle to the same executor does
+	ThreadExecutorImpl *Impl() const
+	{
+		return impl.get();
+	}
+
+#if defined(__cpp_impl_coroutine)
+	// co_await ex.schedule() moves the calling as::task onto this
+	// executor; defined in CoTask.hpp
+	detail::schedule_awaiter schedule();
+#endif
 };
 
 Executor& Executor::GetDefault()
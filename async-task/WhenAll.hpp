@@ -0,0 +1,351 @@
+//
+//  WhenAll.hpp - when_all/when_any combinators over TaskFuture
+//
+//  Copyright (c) 2015 Brian Fransioli
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef AS_WHEN_ALL_HPP
+#define AS_WHEN_ALL_HPP
+
+#include "TaskFuture.hpp"
+#include "TaskImpl.hpp"
+
+#include <array>
+#include <atomic>
+#include <tuple>
+#include <vector>
+
+namespace as {
+
+namespace detail {
+
+// One registration per input future; slots live inside the state
+template<class State>
+struct when_slot
+	: public AsyncContinuation
+{
+	State *state;
+	std::size_t index;
+
+	when_slot()
+		: state(nullptr)
+		, index(0)
+	{}
+
+	void Dispatch()
+	{
+		state->arrive( index, true );
+	}
+
+	void Discard()
+	{
+		state->arrive( index, false );
+	}
+};
+
+// Shared countdown: the result is gathered by the last input to
+// arrive, so a waiter on the combined future is woken exactly once.
+// The state holds two references: the returned future's and one
+// shared by all pending inputs, dropped after the last arrival.
+template<class Derived, class Out>
+class when_all_base
+	: public AsyncResult<Out>
+{
+	std::atomic<std::size_t> remaining;
+	std::atomic<bool> abandoned;
+
+protected:
+	explicit when_all_base(std::size_t count)
+		: remaining(count)
+		, abandoned(false)
+	{
+		this->preset_refs( 2 );
+	}
+
+	void finish()
+	{
+		auto self = static_cast<Derived *>(this);
+
+		if ( abandoned )
+			this->abandon();
+		else
+			self->gather();
+
+		self->release_inputs();
+		this->release();
+	}
+
+public:
+	void arrive(std::size_t, bool ok)
+	{
+		if ( !ok )
+			abandoned = true;
+
+		if ( remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+			finish();
+	}
+};
+
+template<class T>
+struct when_all_vector_result
+{
+	typedef std::vector<T> type;
+};
+
+template<>
+struct when_all_vector_result<void>
+{
+	typedef void type;
+};
+
+template<class T>
+class when_all_vector
+	: public when_all_base< when_all_vector<T>,
+	                        typename when_all_vector_result<T>::type >
+{
+	typedef when_all_base< when_all_vector<T>,
+	                       typename when_all_vector_result<T>::type > base_type;
+
+	friend base_type;
+
+	std::vector< TaskFuture<T> > inputs;
+	std::vector< when_slot<when_all_vector> > slots;
+
+	void gather()
+	{
+		gather( std::is_void<T>{} );
+	}
+
+	void gather(std::false_type)
+	{
+		std::vector<T> values;
+		values.reserve( inputs.size() );
+
+		for ( auto& f : inputs )
+			values.push_back( f.get() );
+
+		this->set( std::move(values) );
+	}
+
+	void gather(std::true_type)
+	{
+		this->set();
+	}
+
+	void release_inputs()
+	{
+		inputs.clear();
+	}
+
+public:
+	explicit when_all_vector(std::vector< TaskFuture<T> > in)
+		: base_type( in.size() )
+		, inputs( std::move(in) )
+		, slots( inputs.size() )
+	{}
+
+	void start()
+	{
+		if ( inputs.empty() ) {
+			this->finish();
+			return;
+		}
+
+		// Once registered, a slot may complete and free inputs at any
+		// moment, so iterate over the slot array instead
+		auto count = slots.size();
+		auto futures = inputs.data();
+
+		for ( std::size_t i = 0; i < count; ++i ) {
+			slots[i].state = this;
+			slots[i].index = i;
+		}
+
+		for ( std::size_t i = 0; i < count; ++i )
+			futures[i].add_continuation( &slots[i] );
+	}
+};
+
+template<class... Ts>
+class when_all_tuple
+	: public when_all_base< when_all_tuple<Ts...>, std::tuple<Ts...> >
+{
+	typedef when_all_base< when_all_tuple<Ts...>, std::tuple<Ts...> > base_type;
+
+	friend base_type;
+
+	static constexpr std::size_t count = sizeof...(Ts);
+
+	std::tuple< TaskFuture<Ts>... > inputs;
+	std::array< when_slot<when_all_tuple>, count > slots;
+
+	template<std::size_t... Ids>
+	void gather(indices<Ids...>)
+	{
+		this->set( std::tuple<Ts...>( std::get<Ids>(inputs).get()... ) );
+	}
+
+	void gather()
+	{
+		gather( typename build_indices<count>::type{} );
+	}
+
+	void release_inputs()
+	{
+		inputs = std::tuple< TaskFuture<Ts>... >();
+	}
+
+	template<std::size_t... Ids>
+	void start(indices<Ids...>)
+	{
+		int expand[] = { 0, ( register_slot<Ids>(), 0 )... };
+		(void)expand;
+	}
+
+	template<std::size_t Id>
+	void register_slot()
+	{
+		std::get<Id>(inputs).add_continuation( &slots[Id] );
+	}
+
+public:
+	explicit when_all_tuple(TaskFuture<Ts>... in)
+		: base_type( count )
+		, inputs( std::move(in)... )
+		, slots()
+	{}
+
+	void start()
+	{
+		for ( std::size_t i = 0; i < count; ++i ) {
+			slots[i].state = this;
+			slots[i].index = i;
+		}
+
+		start( typename build_indices<count>::type{} );
+	}
+};
+
+template<class T>
+class when_any_vector
+	: public AsyncResult<std::size_t>
+{
+	// watched, not consumed: the values stay with the caller's futures
+	std::vector< IntrusivePtr< AsyncResult<T> > > inputs;
+	std::vector< when_slot<when_any_vector> > slots;
+	std::atomic<std::size_t> remaining;
+	std::atomic<bool> decided;
+
+public:
+	explicit when_any_vector(std::vector< TaskFuture<T> > const& in)
+		: inputs()
+		, slots( in.size() )
+		, remaining( in.size() )
+		, decided(false)
+	{
+		inputs.reserve( in.size() );
+
+		for ( auto& f : in )
+			inputs.push_back( f.shared_result() );
+
+		// the returned future and all pending inputs
+		this->preset_refs( 2 );
+	}
+
+	void start()
+	{
+		if ( inputs.empty() ) {
+			this->abandon();
+			this->release();
+			return;
+		}
+
+		auto count = slots.size();
+		auto results = inputs.data();
+
+		for ( std::size_t i = 0; i < count; ++i ) {
+			slots[i].state = this;
+			slots[i].index = i;
+		}
+
+		for ( std::size_t i = 0; i < count; ++i )
+			results[i]->add_continuation( &slots[i] );
+	}
+
+	void arrive(std::size_t index, bool ok)
+	{
+		if ( ok && !decided.exchange( true, std::memory_order_acq_rel ) )
+			this->set( index );
+
+		if ( remaining.fetch_sub( 1, std::memory_order_acq_rel ) != 1 )
+			return;
+
+		if ( !decided.load( std::memory_order_acquire ) )
+			this->abandon();
+
+		inputs.clear();
+		this->release();
+	}
+};
+
+} // namespace as::detail
+
+// Completes with all values, in input order, once every future is set
+template<class T>
+TaskFuture< typename detail::when_all_vector_result<T>::type >
+when_all(std::vector< TaskFuture<T> > futures)
+{
+	typedef detail::when_all_vector<T> state_type;
+	typedef typename detail::when_all_vector_result<T>::type result_type;
+
+	auto state = new state_type( std::move(futures) );
+
+	TaskFuture<result_type> fut{ IntrusivePtr<AsyncResult<result_type>>( state, false ) };
+
+	state->start();
+
+	return fut;
+}
+
+template<class... Ts>
+TaskFuture< std::tuple<Ts...> >
+when_all(TaskFuture<Ts>... futures)
+{
+	static_assert( sizeof...(Ts) > 0, "when_all() needs at least one future" );
+
+	typedef detail::when_all_tuple<Ts...> state_type;
+	typedef std::tuple<Ts...> result_type;
+
+	auto state = new state_type( std::move(futures)... );
+
+	TaskFuture<result_type> fut{ IntrusivePtr<AsyncResult<result_type>>( state, false ) };
+
+	state->start();
+
+	return fut;
+}
+
+// Completes with the index of the first future to become ready; the
+// value itself stays in that future
+template<class T>
+TaskFuture<std::size_t>
+when_any(std::vector< TaskFuture<T> > const& futures)
+{
+	typedef detail::when_any_vector<T> state_type;
+
+	auto state = new state_type( futures );
+
+	TaskFuture<std::size_t> fut{ IntrusivePtr<AsyncResult<std::size_t>>( state, false ) };
+
+	state->start();
+
+	return fut;
+}
+
+} // namespace as
+
+#endif // AS_WHEN_ALL_HPP
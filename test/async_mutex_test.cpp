@@ -0,0 +1,205 @@
+#define AS_USE_COROUTINE_TASKS
+
+#include "Await.hpp"
+#include "AsyncMutex.hpp"
+#include "ThreadExecutor.hpp"
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cassert>
+
+namespace {
+int coroutines = 10000;
+}
+
+void wait_all(std::vector< as::TaskFuture<void> >& futs)
+{
+	for ( auto& f : futs )
+		f.get();
+}
+
+// Holders yield inside the critical section; with std::mutex the first
+// contended lock would block the only executor thread for good
+void mutex_test()
+{
+	as::ThreadExecutor ex;
+	as::AsyncMutex mut;
+	long counter = 0;
+	int inside = 0;
+
+	std::vector< as::TaskFuture<void> > futs;
+
+	for ( int i = 0; i < coroutines; ++i )
+		futs.push_back( as::await( ex, [&]() {
+					std::lock_guard<as::AsyncMutex> lock( mut );
+
+					++inside;
+					assert( inside == 1 );
+
+					auto c = counter;
+					as::this_task::yield();
+					counter = c + 1;
+
+					--inside;
+				} ) );
+
+	// threads contend for it too, blocking themselves only
+	std::vector< std::thread > threads;
+
+	for ( int t = 0; t < 4; ++t )
+		threads.emplace_back( [&]() {
+				for ( int i = 0; i < 1000; ++i ) {
+					std::lock_guard<as::AsyncMutex> lock( mut );
+					++counter;
+				}
+			} );
+
+	for ( auto& t : threads )
+		t.join();
+
+	wait_all( futs );
+
+	assert( counter == coroutines + 4 * 1000 );
+
+	std::cout << coroutines << " coroutines sharing a mutex on one thread: OK\n";
+}
+
+// Waiters get the lock in the order they asked for it
+void fifo_test()
+{
+	as::ThreadExecutor ex;
+	as::AsyncMutex mut;
+	std::vector<int> order;
+
+	mut.lock();
+
+	std::vector< as::TaskFuture<void> > futs;
+	std::atomic<int> started{0};
+
+	for ( int i = 0; i < 100; ++i ) {
+		futs.push_back( as::await( ex, [&, i]() {
+					++started;
+					std::lock_guard<as::AsyncMutex> lock( mut );
+					order.push_back( i );
+				} ) );
+
+		// one at a time, so each is queued before the next starts
+		while( started <= i )
+			std::this_thread::yield();
+	}
+
+	mut.unlock();
+
+	wait_all( futs );
+
+	assert( std::is_sorted( order.begin(), order.end() ) );
+	assert( order.size() == 100 );
+
+	std::cout << "mutex hand-off is FIFO: OK\n";
+}
+
+void condition_variable_test()
+{
+	as::ThreadExecutor ex;
+	as::AsyncMutex mut;
+	as::AsyncConditionVariable cv;
+	std::deque<int> queue;
+	bool done = false;
+	long sum = 0;
+
+	std::vector< as::TaskFuture<void> > futs;
+
+	for ( int c = 0; c < 100; ++c )
+		futs.push_back( as::await( ex, [&]() {
+					std::unique_lock<as::AsyncMutex> lock( mut );
+
+					for (;;) {
+						cv.wait( lock, [&]() { return !queue.empty() || done; } );
+
+						if ( queue.empty() )
+							return;
+
+						sum += queue.front();
+						queue.pop_front();
+					}
+				} ) );
+
+	auto producer = as::await( ex, [&]() {
+			for ( int i = 1; i <= 10000; ++i ) {
+				{
+					std::lock_guard<as::AsyncMutex> lock( mut );
+					queue.push_back( i );
+				}
+
+				cv.notify_one();
+
+				if ( i % 16 == 0 )
+					as::this_task::yield();
+			}
+
+			{
+				std::lock_guard<as::AsyncMutex> lock( mut );
+				done = true;
+			}
+
+			cv.notify_all();
+		} );
+
+	producer.get();
+	wait_all( futs );
+
+	assert( sum == 10000L * 10001 / 2 );
+
+	std::cout << "condition variable: OK\n";
+}
+
+void semaphore_test()
+{
+	as::ThreadExecutor ex, other;
+	as::AsyncSemaphore slots( 3 );
+	std::atomic<int> busy{0};
+	std::atomic<int> most{0};
+
+	std::vector< as::TaskFuture<void> > futs;
+
+	for ( int i = 0; i < 1000; ++i )
+		futs.push_back( as::await( i % 2 ? ex : other, [&]() {
+					slots.acquire();
+
+					auto now = ++busy;
+					auto m = most.load();
+
+					while( now > m && !most.compare_exchange_weak( m, now ) )
+						;
+
+					as::this_task::yield();
+
+					--busy;
+					slots.release();
+				} ) );
+
+	wait_all( futs );
+
+	assert( most <= 3 );
+	assert( slots.available() == 3 );
+	assert( slots.try_acquire() );
+	slots.release();
+
+	std::cout << "semaphore: at most " << most << " of 3 slots busy: OK\n";
+}
+
+int main(int argc, char *argv[])
+{
+	if ( argc > 1 )
+		coroutines = std::stoi( argv[1] );
+
+	mutex_test();
+	fifo_test();
+	condition_variable_test();
+	semaphore_test();
+
+	return 0;
+}
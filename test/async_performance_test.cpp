@@ -11,8 +11,34 @@
 #include <atomic>
 #include <chrono>
 #include <vector>
+#include <new>
 
 #include <cassert>
+#include <cstdlib>
+
+namespace {
+std::atomic<std::size_t> allocation_count{0};
+}
+
+void *operator new(std::size_t size)
+{
+	++allocation_count;
+
+	if ( void *p = std::malloc( size ? size : 1 ) )
+		return p;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free( p );
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	std::free( p );
+}
 
 struct foo
 {
@@ -597,12 +623,16 @@ void function_context_switch_test()
 	for( int i = 0; i < chains; ++i )
 		as::async( ex, [&]() { chain(ex, 0); } );
 
+	auto allocs_before = allocation_count.load();
+
 	clock::time_point start = clock::now();
 	{
 		ex.Run();
 	}
   clock::duration elapsed = clock::now() - start;
 
+  auto allocs = allocation_count.load() - allocs_before;
+
   std::cout << "time per switch: ";
   clock::duration per_iteration = elapsed / iterations / chains;
   std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(per_iteration).count() << " ns\n";
@@ -611,6 +641,9 @@ void function_context_switch_test()
 	  std::cout << "switches per second: ";
 	  std::cout << (std::chrono::seconds(1) / per_iteration) << "\n";
   }
+
+  std::cout << "allocations per async: "
+            << double(allocs) / (double(iterations) * chains) << "\n";
 }
 
 void async_result_test()
@@ -656,6 +689,30 @@ void async_result_test()
 	std::cout << "result: " << r3.get() << "\n";
 }
 
+void async_result_allocation_test()
+{
+	const int calls = 1000;
+
+	as::ThreadExecutor ex;
+
+	// let the executor thread finish its own setup first
+	as::async( ex, []() {} ).get();
+
+	auto allocs_before = allocation_count.load();
+
+	for ( int i = 0; i < calls; ++i ) {
+		auto r = as::async( ex, [i]() { return i; } );
+		assert( r.get() == i );
+	}
+
+	auto allocs = allocation_count.load() - allocs_before;
+
+	std::cout << "allocations per async<int>: " << double(allocs) / calls << "\n";
+
+	// The int result lives inside the control block
+	assert( allocs == calls );
+}
+
 void async_cancel_test()
 {
 	as::ThreadExecutor ex;//("testing");
@@ -708,6 +765,8 @@ int main(int argc, char *argv[])
 
 	async_result_test();
 
+	async_result_allocation_test();
+
 	// invoker_test();
 
 	async_cancel_test();
@@ -3,6 +3,18 @@
 #include "Await.hpp"
 #include "ThreadExecutor.hpp"
 
+#include <atomic>
+#include <vector>
+#include <future>
+#include <algorithm>
+#include <chrono>
+#include <cassert>
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <csignal>
+#include <ctime>
+
 void coro_test()
 {
 // #ifdef AS_USE_COROUTINE_TASKS
@@ -17,8 +29,7 @@ void coro_test()
 				while( x-- ) {
 					std::cout << "A";
 					std::cout.flush();
-					std::this_thread::sleep_for( std::chrono::milliseconds(100) );
-					as::this_task::yield();
+					as::this_task::sleep_for( std::chrono::milliseconds(100) );
 				}
 			} );
 
@@ -33,8 +44,7 @@ void coro_test()
 					for ( auto i = 1; i <= 20; ++i ) {
 						std::cout << "B";
 						std::cout.flush();
-						std::this_thread::sleep_for( std::chrono::milliseconds(100) );
-						as::this_task::yield();
+						as::this_task::sleep_for( std::chrono::milliseconds(100) );
 					}
 
 					std::cout << "Done!\n";
@@ -50,8 +60,437 @@ void coro_test()
 
 }
 
+// Many receiver coroutines share one executor thread; a parked
+// receiver must not hold up the other coroutines on that thread
+void channel_receive_test()
+{
+	as::ThreadExecutor ex;
+	as::Channel<int> ch;
+	std::atomic<long long> sum{0};
+	std::atomic<int> received{0};
+
+	std::vector< as::TaskFuture<void> > receivers;
+
+	for ( int i = 0; i < 200; ++i )
+		receivers.push_back( as::await( ex, [&]() {
+					while( auto v = as::this_task::receive( ch ) ) {
+						sum += *v;
+						++received;
+					}
+				} ) );
+
+	auto other = as::await( ex, []() { return 42; } );
+	assert( other.get() == 42 );
+
+	for ( int i = 0; i < 10000; ++i )
+		ch.Put( as::continuing( i ) );
+
+	ch.Close();
+
+	for ( auto& r : receivers )
+		r.get();
+
+	assert( received == 10000 );
+	assert( sum == 10000LL * 9999 / 2 );
+
+	std::cout << "channel receive: OK\n";
+}
+
+// Stacks of finished coroutines are recycled, so a short-lived
+// coroutine costs neither a fresh mapping nor page faults
+void spawn_test()
+{
+	using clock = std::chrono::high_resolution_clock;
+
+	const int count = 100000;
+	int ran = 0;
+
+	auto body = [&ran]() { ++ran; };
+
+	clock::time_point start = clock::now();
+
+	for ( int i = 0; i < count; ++i ) {
+		as::CoroutineTaskImpl< decltype(body) > coro( body );
+
+		while( coro.Invoke() != as::TaskStatus::Finished )
+			;
+	}
+
+	clock::duration elapsed = clock::now() - start;
+
+	assert( ran == count );
+
+	std::cout << "coroutine spawn: "
+	          << std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count() / count
+	          << " ns\n";
+}
+
+int overflow(int depth)
+{
+	volatile char frame[1024];
+	frame[0] = char(depth);
+
+	return overflow( depth + 1 ) + frame[0];
+}
+
+// Running off the end of a coroutine stack hits the guard page
+void stack_overflow_test()
+{
+	pid_t child = fork();
+
+	if ( child == 0 ) {
+		auto body = []() { overflow( 0 ); };
+		as::CoroutineTaskImpl< decltype(body) > coro( body );
+
+		coro.Invoke();
+		_exit( 0 );
+	}
+
+	int status = 0;
+	waitpid( child, &status, 0 );
+
+	assert( WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV );
+
+	std::cout << "stack overflow: OK\n";
+}
+
+std::chrono::nanoseconds thread_cpu_time()
+{
+	timespec ts;
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+
+	return std::chrono::seconds( ts.tv_sec ) + std::chrono::nanoseconds( ts.tv_nsec );
+}
+
+// An awaiting coroutine is parked, not polled: its thread stays idle
+// (or free for other coroutines) until the value arrives
+void await_future_test()
+{
+	using clock = std::chrono::steady_clock;
+
+	as::ThreadExecutor ex, other;
+	std::atomic<clock::rep> set_at{0};
+
+	std::chrono::nanoseconds cpu{0};
+	clock::duration latency{};
+
+	auto waiting = as::await( ex, [&]() {
+			auto fut = as::async( other, [&]() {
+					std::this_thread::sleep_for( std::chrono::milliseconds(200) );
+					set_at = clock::now().time_since_epoch().count();
+					return 5;
+				} );
+
+			auto before = thread_cpu_time();
+
+			AWAIT( fut );
+
+			latency = clock::now().time_since_epoch() - clock::duration( set_at );
+			cpu = thread_cpu_time() - before;
+
+			return fut.get();
+		} );
+
+	// the executor keeps running other coroutines meanwhile
+	auto other_work = as::await( ex, []() { return 1; } );
+	assert( other_work.get() == 1 );
+
+	assert( waiting.get() == 5 );
+	assert( cpu < std::chrono::milliseconds(20) );
+
+	std::cout << "await future: "
+	          << std::chrono::duration_cast<std::chrono::microseconds>( cpu ).count()
+	          << " us cpu while waiting, resumed "
+	          << std::chrono::duration_cast<std::chrono::microseconds>( latency ).count()
+	          << " us after the value was set\n";
+}
+
+namespace {
+
+struct TimedWork
+	: public as::ThreadWork
+{
+	std::promise< std::chrono::steady_clock::time_point > ran;
+	std::atomic<int> *discarded;
+
+	explicit TimedWork(std::atomic<int> *d = nullptr)
+		: discarded(d)
+	{}
+
+	bool operator()()
+	{
+		ran.set_value( std::chrono::steady_clock::now() );
+		return true;
+	}
+
+	void Release()
+	{}
+
+	void Discard()
+	{
+		++*discarded;
+	}
+};
+
+} // anonymous namespace
+
+// Timers scheduled from another thread wake an idle executor, and a
+// new earliest one is not held up by a later one
+void timer_test()
+{
+	using clock = std::chrono::steady_clock;
+
+	std::atomic<int> discarded{0};
+	TimedWork late, soon, never( &discarded );
+
+	{
+		as::ThreadExecutor ex;
+
+		// let the thread go idle, then wait for the late one
+		std::this_thread::sleep_for( std::chrono::milliseconds(20) );
+
+		auto start = clock::now();
+
+		ex.ScheduleWorkAt( &late, start + std::chrono::milliseconds(300) );
+		std::this_thread::sleep_for( std::chrono::milliseconds(20) );
+
+		ex.ScheduleWorkAt( &soon, start + std::chrono::milliseconds(30) );
+		ex.ScheduleWorkAt( &never, start + std::chrono::hours(1) );
+
+		auto soon_at = soon.ran.get_future().get();
+		auto late_at = late.ran.get_future().get();
+
+		assert( soon_at - start < std::chrono::milliseconds(200) );
+		assert( late_at - start >= std::chrono::milliseconds(300) );
+	}
+
+	// dropped with the executor, not leaked
+	assert( discarded == 1 );
+
+	std::cout << "timers on an idle executor: OK\n";
+}
+
+// Sleeping coroutines sit on the executor's timers, not its thread:
+// thousands of them sleep at once and wake in deadline order
+void sleep_test()
+{
+	using clock = std::chrono::steady_clock;
+
+	const int count = 5000;
+
+	as::ThreadExecutor ex;
+	std::vector<int> woken;
+
+	std::vector< as::TaskFuture<void> > sleepers;
+
+	auto start = clock::now();
+
+	for ( int i = 0; i < count; ++i )
+		sleepers.push_back( as::await( ex, [&, i]() {
+					auto dur = std::chrono::milliseconds( 100 + ( count - i ) % 50 );
+					auto deadline = start + dur;
+
+					as::this_task::sleep_for( deadline - clock::now() );
+
+					assert( clock::now() >= deadline );
+					woken.push_back( ( count - i ) % 50 );
+				} ) );
+
+	// not held up by the sleepers
+	auto other_work = as::await( ex, []() { return 1; } );
+	assert( other_work.get() == 1 );
+	assert( clock::now() - start < std::chrono::milliseconds(100) );
+
+	for ( auto& s : sleepers )
+		s.get();
+
+	auto elapsed = clock::now() - start;
+
+	assert( woken.size() == std::size_t( count ) );
+	assert( std::is_sorted( woken.begin(), woken.end() ) );
+	assert( elapsed < std::chrono::seconds(2) );
+
+	std::cout << count << " sleeping coroutines done after "
+	          << std::chrono::duration_cast<std::chrono::milliseconds>( elapsed ).count()
+	          << " ms\n";
+}
+
+namespace {
+
+std::atomic<int> contexts_alive{0};
+
+struct RequestContext
+{
+	int trace_id = -1;
+
+	RequestContext() { ++contexts_alive; }
+	~RequestContext() { --contexts_alive; }
+};
+
+as::coroutine_local< RequestContext > request_context;
+
+} // anonymous namespace
+
+int current_trace_id()
+{
+	return request_context->trace_id;
+}
+
+// Coroutines interleaving on one thread each keep their own value,
+// which goes away with the coroutine
+void coroutine_local_test()
+{
+	as::ThreadExecutor ex;
+	std::atomic<int> mismatches{0};
+
+	request_context->trace_id = 1000;
+
+	std::vector< as::TaskFuture<void> > handlers;
+
+	for ( int i = 0; i < 100; ++i )
+		handlers.push_back( as::await( ex, [&, i]() {
+					assert( current_trace_id() == -1 );
+
+					request_context->trace_id = i;
+
+					for ( int y = 0; y < 10; ++y ) {
+						as::this_task::yield();
+
+						if ( current_trace_id() != i )
+							++mismatches;
+					}
+				} ) );
+
+	for ( auto& h : handlers )
+		h.get();
+
+	// released after their futures are set
+	as::await( ex, []() {} ).get();
+
+	assert( mismatches == 0 );
+	assert( current_trace_id() == 1000 );
+
+	// only this thread's own is left
+	assert( contexts_alive == 1 );
+
+	std::cout << "coroutine local: OK\n";
+}
+
+// A coroutine busy with channel operations for 200ms, never yielding
+// itself; returns how long a short coroutine queued behind it waited
+std::chrono::milliseconds short_task_delay()
+{
+	using clock = std::chrono::steady_clock;
+
+	as::ThreadExecutor ex;
+	std::atomic<bool> started{false};
+
+	auto hog = as::await( ex, [&]() {
+			as::Channel<int> ch;
+			auto until = clock::now() + std::chrono::milliseconds(200);
+
+			started = true;
+
+			while( clock::now() < until ) {
+				ch.Put( as::continuing( 1 ) );
+				ch.Get();
+			}
+		} );
+
+	while( !started )
+		std::this_thread::yield();
+
+	auto queued = clock::now();
+
+	auto quick = as::await( ex, [&]() {
+			return std::chrono::duration_cast<std::chrono::milliseconds>( clock::now() - queued );
+		} );
+
+	auto delay = quick.get();
+	hog.get();
+
+	return delay;
+}
+
+// A coroutine belongs to the executor, not to the handle it was
+// scheduled through; that handle may be gone by the time it wakes
+void handle_copy_test()
+{
+	as::ThreadExecutor ex, other;
+
+	auto fut = [&]() {
+		auto copy = ex;
+
+		return as::await( copy, [&other]() {
+				auto slow = as::async( other, []() {
+						std::this_thread::sleep_for( std::chrono::milliseconds(20) );
+						return 3;
+					} );
+
+				AWAIT( slow );
+
+				return slow.get();
+			} );
+	}();
+
+	assert( fut.get() == 3 );
+
+	std::cout << "woken after its handle went away: OK\n";
+}
+
+void preemption_test()
+{
+	auto unbounded = short_task_delay();
+
+	as::this_task::set_time_slice( std::chrono::milliseconds(2) );
+
+	auto bounded = short_task_delay();
+
+	// the slice runs from the resume, not from the first check, so
+	// work done before it counts as well
+	as::ThreadExecutor ex;
+	std::atomic<bool> other_ran{false};
+	unsigned checks = 0;
+
+	auto late = as::await( ex, [&]() {
+			auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+
+			while( std::chrono::steady_clock::now() < until )
+				;
+
+			while( !other_ran && checks < 1000 ) {
+				++checks;
+				as::this_task::maybe_yield();
+			}
+		} );
+
+	as::await( ex, [&other_ran]() { other_ran = true; } ).get();
+	late.get();
+
+	as::this_task::set_time_slice( std::chrono::milliseconds(0) );
+
+	assert( checks == as::CoroutineTask::clock_interval );
+
+	assert( unbounded >= std::chrono::milliseconds(100) );
+	assert( bounded < std::chrono::milliseconds(50) );
+
+	std::cout << "short coroutine behind a busy one: waited "
+	          << unbounded.count() << " ms, " << bounded.count()
+	          << " ms with a 2 ms time slice\n";
+}
+
 int main(int argc, char *argv[])
 {
+	spawn_test();
+	stack_overflow_test();
+	channel_receive_test();
+	await_future_test();
+	timer_test();
+	sleep_test();
+	coroutine_local_test();
+	handle_copy_test();
+	preemption_test();
+
 	coro_test();
 
 	return 0;
@@ -0,0 +1,573 @@
+#include "Channel.hpp"
+#include "RingChannelImpl.hpp"
+#include "SpscChannelImpl.hpp"
+#include "Select.hpp"
+#include "BroadcastChannel.hpp"
+#include "PriorityChannelImpl.hpp"
+#include "Promise.hpp"
+
+#include <iostream>
+#include <thread>
+#include <memory>
+#include <iterator>
+#include <vector>
+#include <chrono>
+
+#include <cassert>
+
+namespace {
+unsigned items = 1000000;
+}
+
+template<class Chan>
+void mpmc_test(const char *name, Chan ch, int producers, int consumers)
+{
+	using clock = std::chrono::high_resolution_clock;
+
+	std::atomic<long long> sum{0};
+	std::atomic<unsigned> received{0};
+	std::vector<std::thread> threads;
+
+	const unsigned per_producer = items / producers;
+
+	clock::time_point start = clock::now();
+
+	for ( int c = 0; c < consumers; ++c )
+		threads.emplace_back( [&]() {
+				while( auto v = ch.Get() ) {
+					sum += *v;
+					++received;
+				}
+			} );
+
+	std::vector<std::thread> prods;
+	for ( int p = 0; p < producers; ++p )
+		prods.emplace_back( [&, p]() {
+				for ( unsigned i = 0; i < per_producer; ++i )
+					ch.Put( as::continuing( int( i % 1000 ) ) );
+			} );
+
+	for ( auto& t : prods )
+		t.join();
+
+	ch.Close();
+
+	for ( auto& t : threads )
+		t.join();
+
+	clock::duration elapsed = clock::now() - start;
+
+	long long expected = 0;
+	for ( unsigned i = 0; i < per_producer; ++i )
+		expected += i % 1000;
+	expected *= producers;
+
+	assert( received == per_producer * producers );
+	assert( sum == expected );
+
+	std::cout << name << " " << producers << "p/" << consumers << "c: "
+	          << std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count() / received
+	          << " ns per element\n";
+}
+
+// Producers and consumers move `batch` elements per synchronization
+template<class Chan>
+void batch_mpmc_test(const char *name, Chan ch, int producers, int consumers, std::size_t batch)
+{
+	using clock = std::chrono::high_resolution_clock;
+
+	std::atomic<long long> sum{0};
+	std::atomic<unsigned> received{0};
+	std::vector<std::thread> threads;
+
+	const unsigned per_producer = items / producers;
+
+	clock::time_point start = clock::now();
+
+	for ( int c = 0; c < consumers; ++c )
+		threads.emplace_back( [&]() {
+				std::vector<int> buf( batch );
+				long long local = 0;
+				unsigned count = 0;
+
+				while( auto n = ch.GetMany( buf.begin(), batch ) ) {
+					for ( std::size_t i = 0; i < n; ++i )
+						local += buf[i];
+					count += n;
+				}
+
+				sum += local;
+				received += count;
+			} );
+
+	std::vector<std::thread> prods;
+	for ( int p = 0; p < producers; ++p )
+		prods.emplace_back( [&]() {
+				std::vector<int> buf;
+
+				for ( unsigned i = 0; i < per_producer; i += batch ) {
+					buf.clear();
+
+					for ( unsigned j = i; j < std::min<unsigned>( i + batch, per_producer ); ++j )
+						buf.push_back( j % 1000 );
+
+					ch.PutMany( std::move(buf) );
+				}
+			} );
+
+	for ( auto& t : prods )
+		t.join();
+
+	ch.Close();
+
+	for ( auto& t : threads )
+		t.join();
+
+	clock::duration elapsed = clock::now() - start;
+
+	long long expected = 0;
+	for ( unsigned i = 0; i < per_producer; ++i )
+		expected += i % 1000;
+	expected *= producers;
+
+	assert( received == per_producer * producers );
+	assert( sum == expected );
+
+	std::cout << name << " " << producers << "p/" << consumers << "c batch " << batch << ": "
+	          << std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count() / received
+	          << " ns per element\n";
+}
+
+template<class Chan>
+void batch_semantics_test(const char *name, Chan ch)
+{
+	std::vector<int> in{ 1, 2, 3, 4, 5 };
+	std::vector<int> out;
+
+	assert( ch.PutMany( in ) == 5 );
+	assert( in.size() == 5 );
+
+	// a short batch is returned as soon as something is available
+	assert( ch.GetMany( std::back_inserter(out), 3 ) == 3 );
+	assert( ch.GetMany( std::back_inserter(out), 3, std::chrono::milliseconds(1) ) == 2 );
+	assert( ( out == std::vector<int>{ 1, 2, 3, 4, 5 } ) );
+
+	assert( ch.GetMany( std::back_inserter(out), 3, std::chrono::milliseconds(1) ) == 0 );
+	assert( ch.IsOpen() );
+
+	ch.PutMany( std::vector<int>{ 6 } );
+	ch.Close();
+
+	assert( ch.PutMany( std::vector<int>{ 7, 8 } ) == 0 );
+
+	assert( ch.GetMany( std::back_inserter(out), 3 ) == 1 );
+	assert( ch.GetMany( std::back_inserter(out), 3 ) == 0 );
+	assert( out.back() == 6 );
+
+	std::cout << name << " batch semantics: OK\n";
+}
+
+// Close refuses further elements, whichever the implementation
+template<class Chan>
+void closed_put_test(const char *name, Chan ch)
+{
+	assert( ch.Put( as::continuing(1) ) );
+	ch.Close();
+	assert( !ch.Put( as::continuing(2) ) );
+
+	assert( *ch.Get() == 1 );
+	assert( !ch.Get() );
+
+	std::cout << name << " put after close: OK\n";
+}
+
+template<class Impl>
+void bounded_semantics_test(const char *name)
+{
+	as::Channel< int, Impl > ch( 3 );
+
+	assert( ch.Count() == 0 );
+
+	// capacity rounds up to a power of two
+	for ( int i = 0; i < 4; ++i )
+		assert( ch.TryPut( as::continuing(i) ) );
+
+	assert( !ch.TryPut( as::continuing(4) ) );
+	assert( ch.Count() == 4 );
+
+	assert( *ch.Get() == 0 );
+	assert( ch.TryPut( as::continuing(4) ) );
+
+	ch.Close();
+	assert( !ch.Put( as::continuing(5) ) );
+
+	// remaining items drain after Close
+	for ( int i = 1; i <= 4; ++i )
+		assert( *ch.Get() == i );
+
+	assert( !ch.Get() );
+	assert( ch.WaitFor( std::chrono::milliseconds(1) ) == as::WaitStatus::Ready );
+
+	as::Channel< int, Impl > empty;
+	assert( empty.WaitFor( std::chrono::milliseconds(1) ) == as::WaitStatus::Timeout );
+
+	std::cout << name << " semantics: OK\n";
+}
+
+// Values are moved in and out of the buffer, so move-only types work
+// and the end of the stream is an empty result rather than a null one
+template<class Chan>
+void inline_value_test(const char *name, Chan ch)
+{
+	ch.Put( as::continuing( std::unique_ptr<int>( new int(7) ) ) );
+	ch.Put( as::TaskResult< std::unique_ptr<int> >( as::TaskStatus::Continuing ) );
+	ch.Put( as::continuing( std::unique_ptr<int>() ) );
+	ch.Close();
+
+	auto first = ch.Get();
+	assert( first && **first == 7 );
+
+	// a null element is still an element; only the end is empty
+	auto second = ch.Get();
+	assert( second && !*second );
+
+	assert( !ch.Get() );
+
+	std::cout << name << " inline values: OK\n";
+}
+
+template<class Chan>
+void range_for_test(const char *name, Chan ch)
+{
+	std::thread producer( [ch]() mutable {
+			for ( int i = 0; i < 10000; ++i )
+				ch.Put( as::continuing( i ) );
+			ch.Close();
+		} );
+
+	long long sum = 0;
+	int count = 0;
+	int last = -1;
+
+	for ( auto& v : ch ) {
+		assert( v == last + 1 );
+		last = v;
+		sum += v;
+		++count;
+	}
+
+	producer.join();
+
+	assert( count == 10000 );
+	assert( sum == 10000LL * 9999 / 2 );
+
+	// a canceled, empty channel ends the loop right away
+	Chan canceled;
+	canceled.Cancel();
+
+	for ( auto& v : canceled ) {
+		(void)v;
+		assert( false );
+	}
+
+	// explicit batch size
+	Chan small;
+	small.Put( as::continuing( 1 ) );
+	small.Put( as::continuing( 2 ) );
+	small.Close();
+
+	count = 0;
+	for ( auto it = small.begin( 1 ); it != small.end(); ++it )
+		count += *it;
+
+	assert( count == 3 );
+
+	std::cout << name << " range-for: OK\n";
+}
+
+void select_test()
+{
+	using std::chrono::milliseconds;
+
+	as::Channel<int> a;
+	as::Channel< int, as::RingChannelImpl<int> > b;
+	as::Promise<int> promise;
+	auto fut = promise.get_future();
+
+	assert( as::select_for( milliseconds(5), a, b, fut ) == -1 );
+
+	// wakes on a later Put without polling
+	std::thread t( [&]() {
+			std::this_thread::sleep_for( milliseconds(10) );
+			b.Put( as::continuing( 42 ) );
+		} );
+
+	assert( as::select( a, b, fut ) == 1 );
+	assert( *b.Get() == 42 );
+	t.join();
+
+	std::thread t2( [&]() {
+			std::this_thread::sleep_for( milliseconds(10) );
+			promise.set_value( 7 );
+		} );
+
+	assert( as::select( a, b, fut ) == 2 );
+	assert( fut.get() == 7 );
+	t2.join();
+
+	// a closed channel is ready; the first ready source wins
+	b.Close();
+	a.Close();
+	assert( as::select( a, b ) == 0 );
+
+	// one consumer multiplexing several producers
+	as::Channel< int, as::SpscChannelImpl<int> > in[3];
+	std::vector<std::thread> producers;
+
+	for ( int p = 0; p < 3; ++p )
+		producers.emplace_back( [&, p]() {
+				for ( int i = 0; i < 1000; ++i )
+					in[p].Put( as::continuing( 1 ) );
+			} );
+
+	int sum = 0;
+
+	while( sum < 3000 ) {
+		int i = as::select( in[0], in[1], in[2] );
+
+		if ( auto v = in[i].Get() )
+			sum += *v;
+	}
+
+	for ( auto& p : producers )
+		p.join();
+
+	assert( sum == 3000 );
+
+	std::cout << "select: OK\n";
+}
+
+void broadcast_test()
+{
+	using clock = std::chrono::high_resolution_clock;
+
+	// a lagging subscriber skips ahead and learns how much it missed
+	{
+		as::BroadcastChannel<int> ch( 4, as::BroadcastOverflow::DropOldest );
+		auto sub = ch.Subscribe();
+
+		for ( int i = 0; i < 10; ++i )
+			assert( ch.Put( as::continuing(i) ) );
+
+		assert( sub.Count() == 4 );
+		assert( *sub.Get() == 6 );
+		assert( sub.TakeMissed() == 6 );
+		assert( sub.TakeMissed() == 0 );
+
+		ch.Close();
+		assert( !ch.Put( as::continuing(10) ) );
+
+		for ( int i = 7; i < 10; ++i )
+			assert( *sub.Get() == i );
+
+		assert( !sub.Get() );
+	}
+
+	// the producer waits out a pinned slot without holding the channel
+	// lock, so the reader's callback can still use the channel
+	{
+		as::BroadcastChannel<int> ch( 2, as::BroadcastOverflow::DropOldest );
+		auto sub = ch.Subscribe();
+		auto other = ch.Subscribe();
+		std::thread producer;
+
+		assert( ch.Put( as::continuing(0) ) );
+
+		sub.Consume( [&](int v) {
+				assert( v == 0 );
+
+				producer = std::thread( [&ch]() {
+						for ( int i = 1; i < 5; ++i )
+							assert( ch.Put( as::continuing(i) ) );
+					} );
+
+				// let it fill the ring and reach the slot we are on
+				std::this_thread::sleep_for( std::chrono::milliseconds(50) );
+
+				assert( ch.Subscribers() == 2 );
+				auto gone = std::move( other );
+			} );
+
+		producer.join();
+		ch.Close();
+
+		int received = 0;
+		while( sub.Get() )
+			++received;
+
+		assert( ch.Subscribers() == 1 );
+		assert( received + sub.TakeMissed() == 4 );
+	}
+
+	// every subscriber sees every element, in order, without copies
+	const int subscribers = 32;
+	const int count = items / 10;
+
+	as::BroadcastChannel< std::vector<int> > ch( 256 );
+	std::vector< as::BroadcastSubscriber< std::vector<int> > > subs;
+
+	for ( int i = 0; i < subscribers; ++i )
+		subs.push_back( ch.Subscribe() );
+
+	assert( ch.Subscribers() == subscribers );
+
+	std::vector<std::thread> threads;
+	std::atomic<long long> total{0};
+
+	for ( auto& sub : subs )
+		threads.emplace_back( [&]() {
+				long long sum = 0;
+				int expected = 0;
+
+				while( sub.Consume( [&](std::vector<int> const& v) {
+							assert( v[0] == expected );
+							++expected;
+							sum += v[0];
+						} ) )
+					;
+
+				assert( expected == count );
+				total += sum;
+			} );
+
+	clock::time_point start = clock::now();
+
+	for ( int i = 0; i < count; ++i )
+		ch.Put( as::continuing( std::vector<int>( 16, i ) ) );
+
+	ch.Close();
+
+	for ( auto& t : threads )
+		t.join();
+
+	clock::duration elapsed = clock::now() - start;
+
+	assert( total == subscribers * ( (long long)count * ( count - 1 ) / 2 ) );
+
+	std::cout << "broadcast to " << subscribers << ": "
+	          << std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count() / count
+	          << " ns per element\n";
+}
+
+void priority_test()
+{
+	using clock = std::chrono::high_resolution_clock;
+
+	// default order: greatest first
+	{
+		as::Channel< int, as::PriorityChannelImpl<int> > ch;
+
+		for ( int v : { 5, 1, 9, 3, 7 } )
+			ch.Put( as::continuing(v) );
+
+		assert( ch.Count() == 5 );
+		assert( *ch.Get() == 9 );
+
+		std::vector<int> out;
+		assert( ch.GetMany( std::back_inserter(out), 2 ) == 2 );
+		assert( ( out == std::vector<int>{ 7, 5 } ) );
+
+		ch.Close();
+		assert( !ch.Put( as::continuing(10) ) );
+
+		assert( *ch.Get() == 3 );
+		assert( *ch.Get() == 1 );
+		assert( !ch.Get() );
+	}
+
+	// earliest deadline first, through both PutMany paths
+	{
+		typedef std::pair<int, int> job;	// deadline, id
+		as::Channel< job, as::PriorityChannelImpl< job, std::greater<job> > > ch;
+
+		std::vector<job> jobs;
+		for ( int i = 0; i < 1000; ++i )
+			jobs.emplace_back( ( i * 7919 ) % 1000, i );
+
+		// larger than the heap: rebuilt in one pass
+		ch.PutMany( std::vector<job>( jobs.begin(), jobs.begin() + 600 ) );
+		// smaller: sifted in one at a time
+		ch.PutMany( std::vector<job>( jobs.begin() + 600, jobs.end() ) );
+
+		for ( int deadline = 0; deadline < 1000; ++deadline )
+			assert( ch.Get()->first == deadline );
+
+		assert( ch.Count() == 0 );
+	}
+
+	// steady state: one push and one pop against a deep heap
+	{
+		as::Channel< int, as::PriorityChannelImpl< int, std::greater<int> > > ch;
+		const int queued = 100000;
+
+		for ( int i = 0; i < queued; ++i )
+			ch.Put( as::continuing( int( ( i * 7919LL ) % queued ) ) );
+
+		const int ops = items;
+		clock::time_point start = clock::now();
+
+		for ( int i = 0; i < ops; ++i ) {
+			int v = *ch.Get();
+			ch.Put( as::continuing( v + queued ) );
+		}
+
+		clock::duration elapsed = clock::now() - start;
+
+		std::cout << "priority push+pop with " << queued << " queued: "
+		          << std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count() / ops
+		          << " ns\n";
+	}
+
+	std::cout << "priority: OK\n";
+}
+
+int main(int argc, char *argv[])
+{
+	if ( argc > 1 )
+		items = std::stoi( argv[1] );
+
+	closed_put_test( "vector", as::Channel<int>() );
+	closed_put_test( "ring", as::Channel< int, as::RingChannelImpl<int> >() );
+	bounded_semantics_test< as::RingChannelImpl<int> >( "ring" );
+	bounded_semantics_test< as::SpscChannelImpl<int> >( "spsc" );
+	select_test();
+	broadcast_test();
+	priority_test();
+	range_for_test( "vector", as::Channel<int>() );
+	range_for_test( "ring", as::Channel< int, as::RingChannelImpl<int> >() );
+	range_for_test( "spsc", as::Channel< int, as::SpscChannelImpl<int> >() );
+	batch_semantics_test( "vector", as::Channel<int>() );
+	batch_semantics_test( "ring", as::Channel< int, as::RingChannelImpl<int> >( 8 ) );
+	batch_semantics_test( "spsc", as::Channel< int, as::SpscChannelImpl<int> >( 8 ) );
+	batch_semantics_test( "priority",
+	                      as::Channel< int, as::PriorityChannelImpl< int, std::greater<int> > >() );
+	inline_value_test( "vector", as::Channel< std::unique_ptr<int> >() );
+	inline_value_test( "ring", as::Channel< std::unique_ptr<int>,
+	                   as::RingChannelImpl< std::unique_ptr<int> > >() );
+	inline_value_test( "spsc", as::Channel< std::unique_ptr<int>,
+	                   as::SpscChannelImpl< std::unique_ptr<int> > >() );
+
+	mpmc_test( "vector", as::Channel<int>(), 1, 1 );
+	mpmc_test( "ring", as::Channel< int, as::RingChannelImpl<int> >(), 1, 1 );
+	mpmc_test( "spsc", as::Channel< int, as::SpscChannelImpl<int> >(), 1, 1 );
+
+	mpmc_test( "vector", as::Channel<int>(), 4, 4 );
+	mpmc_test( "ring", as::Channel< int, as::RingChannelImpl<int> >(), 4, 4 );
+	mpmc_test( "priority", as::Channel< int, as::PriorityChannelImpl<int> >(), 4, 4 );
+
+	batch_mpmc_test( "vector", as::Channel<int>(), 4, 4, 64 );
+	batch_mpmc_test( "ring", as::Channel< int, as::RingChannelImpl<int> >(), 4, 4, 64 );
+	batch_mpmc_test( "spsc", as::Channel< int, as::SpscChannelImpl<int> >(), 1, 1, 64 );
+
+	return 0;
+}
@@ -0,0 +1,173 @@
+#include <iostream>
+
+#if defined(__cpp_impl_coroutine)
+
+#include "CoTask.hpp"
+#include "Async.hpp"
+
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <cassert>
+
+#include <unistd.h>
+
+namespace {
+int tasks = 100000;
+}
+
+std::size_t resident_bytes()
+{
+	std::size_t pages = 0, resident = 0;
+
+	std::ifstream( "/proc/self/statm" ) >> pages >> resident;
+
+	return resident * ::sysconf( _SC_PAGESIZE );
+}
+
+as::task<int> answer()
+{
+	co_return 42;
+}
+
+as::task<int> add(int a, int b)
+{
+	co_return co_await answer() - 42 + a + b;
+}
+
+as::task<void> fail()
+{
+	throw std::runtime_error( "failed" );
+	co_return;
+}
+
+void nested_test()
+{
+	as::ThreadExecutor ex;
+
+	assert( as::spawn( ex, add( 1, 2 ) ).get() == 3 );
+
+	auto caught = as::spawn( ex, []() -> as::task<bool> {
+			try {
+				co_await fail();
+			} catch (std::runtime_error const&) {
+				co_return true;
+			}
+
+			co_return false;
+		}() );
+
+	assert( caught.get() );
+
+	std::cout << "nested tasks: OK\n";
+}
+
+as::task<bool> hop(as::ThreadExecutor& first, as::ThreadExecutor& second)
+{
+	co_await second.schedule();
+	bool on_second = second.IsCurrent() && !first.IsCurrent();
+
+	co_await first.schedule();
+	bool on_first = first.IsCurrent() && !second.IsCurrent();
+
+	co_return on_second && on_first;
+}
+
+void schedule_test()
+{
+	as::ThreadExecutor first, second;
+
+	assert( as::spawn( first, hop( first, second ) ).get() );
+
+	std::cout << "executor switch: OK\n";
+}
+
+as::task<bool> wait_for_future(as::ThreadExecutor& ex, as::ThreadExecutor& other)
+{
+	int v = co_await as::async( other, []() {
+			std::this_thread::sleep_for( std::chrono::milliseconds(10) );
+			return 7;
+		} );
+
+	// resumed on its own executor, not the one that set the value
+	co_return v == 7 && ex.IsCurrent();
+}
+
+void future_test()
+{
+	as::ThreadExecutor ex, other;
+
+	assert( as::spawn( ex, wait_for_future( ex, other ) ).get() );
+
+	std::cout << "await future: OK\n";
+}
+
+as::task<void> receive_all(as::Channel<int>& ch, std::atomic<long long>& sum,
+                           std::atomic<int>& parked)
+{
+	++parked;
+
+	while( auto v = co_await as::receive( ch ) )
+		sum += *v;
+}
+
+// Parked tasks cost their frame only
+void receive_test()
+{
+	as::ThreadExecutor ex;
+	as::Channel<int> ch;
+	std::atomic<long long> sum{0};
+	std::atomic<int> parked{0};
+
+	std::vector< as::TaskFuture<void> > receivers;
+	receivers.reserve( tasks );
+
+	auto before = resident_bytes();
+
+	for ( int i = 0; i < tasks; ++i )
+		receivers.push_back( as::spawn( ex, receive_all( ch, sum, parked ) ) );
+
+	while( parked < tasks )
+		std::this_thread::yield();
+
+	auto used = resident_bytes() - before;
+
+	for ( int i = 0; i < tasks; ++i )
+		ch.Put( as::continuing( i ) );
+
+	ch.Close();
+
+	for ( auto& r : receivers )
+		r.get();
+
+	assert( sum == (long long)tasks * ( tasks - 1 ) / 2 );
+
+	// frame, future and channel registration
+	std::cout << tasks << " parked tasks: " << used / tasks << " resident bytes each\n";
+
+	assert( used / tasks < 4096 );
+}
+
+int main(int argc, char *argv[])
+{
+	if ( argc > 1 )
+		tasks = std::stoi( argv[1] );
+
+	nested_test();
+	schedule_test();
+	future_test();
+	receive_test();
+
+	return 0;
+}
+
+#else
+
+int main()
+{
+	std::cout << "C++20 coroutines not available; skipped\n";
+	return 0;
+}
+
+#endif
@@ -0,0 +1,307 @@
+#include "Async.hpp"
+#include "WhenAll.hpp"
+#include "Promise.hpp"
+
+#include <iostream>
+#include <string>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+#include <cassert>
+
+template<class Future>
+bool fails_with(Future& f, std::future_errc code)
+{
+	try {
+		f.get();
+	} catch( std::future_error const& e ) {
+		return e.code() == code;
+	}
+
+	return false;
+}
+
+// Canceled while queued behind a sleeper, so it never runs
+as::TaskFuture<int> canceled_task(as::ThreadExecutor& ex)
+{
+	as::async( ex, []() {
+			std::this_thread::sleep_for( std::chrono::milliseconds(50) );
+		} );
+
+	auto f = as::async( ex, []() { return 0; } );
+	f.cancel();
+
+	return f;
+}
+
+void then_test()
+{
+	as::ThreadExecutor ex;
+	as::ThreadExecutor ex2;
+
+	auto r = as::async( ex, []() {
+			std::this_thread::sleep_for( std::chrono::milliseconds(100) );
+			return 20;
+		} )
+		.then( ex2, [](int i) {
+				return i + 1;
+			} )
+		.then( ex, [](int i) {
+				return std::to_string( i * 2 );
+			} );
+
+	assert( r.get() == "42" );
+
+	// continuation on an already completed future
+	auto done = as::async( ex, []() { return 1; } );
+	while( !done.ready() )
+		std::this_thread::yield();
+
+	auto v = done.then( ex2, [](int) {} );
+	v.get();
+
+	// void antecedent
+	auto w = as::async( ex, []() {} ).then( []() { return 7; } );
+	assert( w.get() == 7 );
+
+	// registered from the target executor after completion: runs inline
+	as::async( ex, [&ex, &ex2]() {
+			auto f = as::async( ex2, []() { return 3; } );
+			while( !f.ready() )
+				std::this_thread::yield();
+
+			bool ran = false;
+			f.then( ex, [&ran](int) { ran = true; } );
+			assert( ran );
+		} ).get();
+
+	// the continuation outlives the handle it was registered with
+	as::TaskFuture<int> later;
+	{
+		auto copy = ex2;
+		later = as::async( ex, []() {
+				std::this_thread::sleep_for( std::chrono::milliseconds(20) );
+				return 1;
+			} ).then( copy, [](int i) { return i + 1; } );
+	}
+	assert( later.get() == 2 );
+
+	// a canceled antecedent never produces a value, so neither does
+	// its continuation
+	auto orphan = canceled_task( ex ).then( ex2, [](int i) { return i; } );
+	assert( fails_with( orphan, std::future_errc::broken_promise ) );
+
+	std::cout << "then: OK\n";
+}
+
+void then_chain_performance_test()
+{
+	const int links = 100000;
+
+	using clock = std::chrono::high_resolution_clock;
+
+	as::ThreadExecutor ex;
+
+	auto fut = as::async( ex, []() { return 0; } );
+
+	clock::time_point start = clock::now();
+
+	for ( int i = 0; i < links; ++i )
+		fut = fut.then( ex, [](int n) { return n + 1; } );
+
+	assert( fut.get() == links );
+
+	clock::duration elapsed = clock::now() - start;
+
+	std::cout << "time per continuation: "
+	          << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed / links).count()
+	          << " ns\n";
+}
+
+void when_all_test()
+{
+	as::ThreadExecutor ex;
+	as::ThreadExecutor ex2;
+
+	const int shards = 10000;
+
+	std::vector< as::TaskFuture<int> > futures;
+	futures.reserve( shards );
+
+	for ( int i = 0; i < shards; ++i )
+		futures.push_back( as::async( i % 2 ? ex : ex2, [i]() { return i; } ) );
+
+	auto all = as::when_all( std::move(futures) ).get();
+
+	assert( all.size() == shards );
+	for ( int i = 0; i < shards; ++i )
+		assert( all[i] == i );
+
+	std::vector< as::TaskFuture<void> > voids;
+	for ( int i = 0; i < 100; ++i )
+		voids.push_back( as::async( ex, []() {} ) );
+
+	as::when_all( std::move(voids) ).get();
+
+	as::when_all( std::vector< as::TaskFuture<int> >{} ).get();
+
+	auto t = as::when_all( as::async( ex, []() { return 1; } ),
+	                       as::async( ex2, []() { return std::string("two"); } ) ).get();
+
+	assert( std::get<0>(t) == 1 );
+	assert( std::get<1>(t) == "two" );
+
+	// an abandoned input fails the whole instead of hanging it
+	std::vector< as::TaskFuture<int> > partial;
+	partial.push_back( as::async( ex2, []() { return 1; } ) );
+	partial.push_back( canceled_task( ex ) );
+
+	auto broken = as::when_all( std::move(partial) );
+	assert( fails_with( broken, std::future_errc::broken_promise ) );
+
+	auto broken_tuple = as::when_all( canceled_task( ex ), as::async( ex2, []() { return 2; } ) );
+	assert( fails_with( broken_tuple, std::future_errc::broken_promise ) );
+
+	std::cout << "when_all: OK\n";
+}
+
+void when_any_test()
+{
+	as::ThreadExecutor ex;
+	as::ThreadExecutor ex2;
+
+	std::vector< as::TaskFuture<int> > futures;
+
+	futures.push_back( as::async( ex, []() {
+				std::this_thread::sleep_for( std::chrono::milliseconds(200) );
+				return 1;
+			} ) );
+	futures.push_back( as::async( ex2, []() { return 2; } ) );
+
+	auto idx = as::when_any( futures ).get();
+
+	assert( idx == 1 );
+	assert( futures[idx].get() == 2 );
+	assert( futures[0].get() == 1 );
+
+	// fails only once none of them can be ready
+	std::vector< as::TaskFuture<int> > none;
+	none.push_back( canceled_task( ex ) );
+	none.push_back( canceled_task( ex2 ) );
+
+	auto never = as::when_any( none );
+	assert( fails_with( never, std::future_errc::broken_promise ) );
+
+	std::cout << "when_any: OK\n";
+}
+
+// The value is moved out to the one consumer, so a future cannot be
+// copied and a second get() throws instead of returning what is left
+void single_consumer_test()
+{
+	as::ThreadExecutor ex;
+
+	static_assert( !std::is_copy_constructible< as::TaskFuture<int> >::value,
+	               "TaskFuture must be move-only" );
+
+	auto f = as::async( ex, []() {
+			return std::unique_ptr<int>( new int(42) );
+		} );
+
+	auto moved = std::move( f );
+	assert( *moved.get() == 42 );
+	assert( fails_with( moved, std::future_errc::future_already_retrieved ) );
+
+	// then() takes the value as well: no second then(), no get() after
+	auto g = as::async( ex, []() { return std::string( "moved" ); } );
+	auto h = g.then( ex, [](std::string s) { return s.size(); } );
+
+	bool threw = false;
+
+	try {
+		g.then( ex, [](std::string s) { return s.size(); } );
+	} catch( std::future_error const& e ) {
+		threw = e.code() == std::future_errc::future_already_retrieved;
+	}
+
+	assert( threw );
+	assert( h.get() == 5 );
+	assert( fails_with( g, std::future_errc::future_already_retrieved ) );
+
+	std::cout << "single consumer: OK\n";
+}
+
+void promise_test()
+{
+	as::ThreadExecutor ex;
+
+	as::Promise<int> p;
+	auto fut = p.get_future();
+
+	bool on_ex = false;
+	auto cont = fut.then( ex, [&ex, &on_ex](int i) {
+			on_ex = ex.IsCurrent();
+			return i * 2;
+		} );
+
+	// completion arrives from a foreign thread, no executor involved
+	std::thread callback_thread( [&p]() {
+			std::this_thread::sleep_for( std::chrono::milliseconds(50) );
+			p.set_value( 21 );
+		} );
+
+	assert( cont.get() == 42 );
+	assert( on_ex );
+
+	callback_thread.join();
+
+	as::Promise<void> vp;
+	auto vfut = vp.get_future();
+	vp.set_value();
+	vfut.get();
+
+	// only one future per promise
+	bool threw = false;
+
+	try {
+		vp.get_future();
+	} catch( std::future_error const& e ) {
+		threw = e.code() == std::future_errc::future_already_retrieved;
+	}
+
+	assert( threw );
+
+	// broken promise: waiters get an error, continuations are discarded
+	as::TaskFuture<int> orphan;
+	as::TaskFuture<void> never;
+	{
+		as::Promise<int> broken;
+		orphan = broken.get_future();
+
+		as::Promise<int> broken_too;
+		never = broken_too.get_future().then( ex, [](int) { assert( false ); } );
+	}
+
+	assert( fails_with( orphan, std::future_errc::broken_promise ) );
+	assert( fails_with( never, std::future_errc::broken_promise ) );
+
+	std::cout << "promise: OK\n";
+}
+
+int main()
+{
+	then_test();
+
+	then_chain_performance_test();
+
+	when_all_test();
+
+	when_any_test();
+
+	single_consumer_test();
+
+	promise_test();
+
+	return 0;
+}
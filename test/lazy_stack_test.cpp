@@ -0,0 +1,120 @@
+#define AS_USE_COROUTINE_TASKS
+#define AS_LAZY_COROUTINE_STACKS
+
+#include "Await.hpp"
+#include "ThreadExecutor.hpp"
+
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <cassert>
+
+#include <unistd.h>
+
+namespace {
+int coroutines = 10000;
+}
+
+std::size_t resident_bytes()
+{
+	std::size_t pages = 0, resident = 0;
+
+	std::ifstream( "/proc/self/statm" ) >> pages >> resident;
+
+	return resident * ::sysconf( _SC_PAGESIZE );
+}
+
+// Touches about kb kilobytes of stack
+int descend(int kb)
+{
+	volatile char frame[1024];
+	frame[0] = char(kb);
+
+	if ( kb <= 1 )
+		return frame[0];
+
+	return descend( kb - 1 ) + frame[0];
+}
+
+// Every coroutine may use megabytes of stack, yet parked coroutines
+// that only used a little cost about that much memory
+void concurrent_test()
+{
+	as::ThreadExecutor ex;
+	as::Channel<int> ch;
+	std::atomic<int> parked{0};
+	std::atomic<int> received{0};
+
+	auto before = resident_bytes();
+
+	std::vector< as::TaskFuture<void> > waiting;
+
+	for ( int i = 0; i < coroutines; ++i )
+		waiting.push_back( as::await( ex, [&]() {
+					descend( 4 );
+					++parked;
+
+					while( as::this_task::receive( ch ) )
+						++received;
+				} ) );
+
+	while( parked < coroutines )
+		std::this_thread::yield();
+
+	auto used = resident_bytes() - before;
+
+	// a deep one still fits
+	auto deep = as::await( ex, []() { return descend( 2048 ); } );
+	deep.get();
+
+	for ( int i = 0; i < coroutines; ++i )
+		ch.Put( as::continuing( i ) );
+
+	ch.Close();
+
+	for ( auto& w : waiting )
+		w.get();
+
+	assert( received == coroutines );
+
+	std::cout << coroutines << " parked coroutines: "
+	          << used / coroutines << " resident bytes each\n";
+
+	// 64KB would have been committed per coroutine before
+	assert( used / coroutines < 32 * 1024 );
+}
+
+// A released stack gives back the pages it no longer needs
+void trim_test()
+{
+	as::ThreadExecutor ex;
+
+	as::await( ex, []() { return descend( 16 ); } ).get();
+	as::await( ex, []() { return 0; } ).get();
+
+	auto before = resident_bytes();
+
+	as::await( ex, []() { return descend( 4096 ); } ).get();
+
+	// the value is set before the executor releases the stack; once a
+	// later coroutine has run, the deep one has been put back
+	as::await( ex, []() { return 0; } ).get();
+
+	auto after = resident_bytes();
+
+	std::cout << "resident after a 4MB deep coroutine: "
+	          << ( after > before ? after - before : 0 ) / 1024 << " KB more\n";
+
+	assert( after < before + 1024 * 1024 );
+}
+
+int main(int argc, char *argv[])
+{
+	if ( argc > 1 )
+		coroutines = std::stoi( argv[1] );
+
+	concurrent_test();
+	trim_test();
+
+	return 0;
+}
@@ -0,0 +1,85 @@
+#define AS_USE_COROUTINE_TASKS
+#define AS_PROFILE_COROUTINE_STACKS
+
+#include "Await.hpp"
+#include "ThreadExecutor.hpp"
+
+#include <vector>
+#include <iostream>
+#include <cassert>
+
+// Touches about kb kilobytes of stack
+int descend(int kb)
+{
+	volatile char frame[1024];
+	frame[0] = char(kb);
+
+	if ( kb <= 1 )
+		return frame[0];
+
+	return descend( kb - 1 ) + frame[0];
+}
+
+struct Shallow
+{
+	int operator()() const { return descend( 4 ); }
+};
+
+struct Deep
+{
+	int operator()() const { return descend( 40 ); }
+};
+
+as::StackUsage const& find(std::vector< as::StackUsage > const& usage, char const *name)
+{
+	for ( auto& u : usage )
+		if ( u.function.find( name ) != std::string::npos )
+			return u;
+
+	assert( !"function type not profiled" );
+	return usage.front();
+}
+
+// Each function type's peak is what its deepest run touched
+void peak_test()
+{
+	as::ThreadExecutor ex;
+
+	std::vector< as::TaskFuture<int> > futs;
+
+	for ( int i = 0; i < 100; ++i )
+		futs.push_back( as::await( ex, Shallow{} ) );
+
+	futs.push_back( as::await( ex, Deep{} ) );
+
+	for ( auto& f : futs )
+		f.get();
+
+	// released after their futures are set; one more coroutine on the
+	// executor and all of those are done
+	as::await( ex, []() { return 0; } ).get();
+
+	auto usage = as::StackProfile::Get().Snapshot();
+
+	as::StackProfile::Get().Report( std::cout );
+
+	auto& shallow = find( usage, "Shallow" );
+	auto& deep = find( usage, "Deep" );
+
+	assert( shallow.runs == 100 );
+	assert( deep.runs == 1 );
+
+	assert( shallow.peak >= 4 * 1024 && shallow.peak < 16 * 1024 );
+	assert( deep.peak >= 40 * 1024 && deep.peak < deep.stack_size );
+	assert( shallow.average <= shallow.peak );
+
+	// deepest first
+	assert( usage.front().peak >= deep.peak );
+}
+
+int main()
+{
+	peak_test();
+
+	return 0;
+}
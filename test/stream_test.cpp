@@ -0,0 +1,215 @@
+#include "Stream.hpp"
+#include "ThreadExecutor.hpp"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+#include <cassert>
+
+namespace {
+unsigned items = 1000000;
+}
+
+template<class Chan>
+std::thread produce(Chan ch, int count, std::atomic<int> *produced = nullptr)
+{
+	return std::thread( [ch, count, produced]() mutable {
+			for ( int i = 0; i < count; ++i ) {
+				if ( !ch.Put( as::continuing(i) ) )
+					break;
+
+				if ( produced )
+					++*produced;
+			}
+
+			ch.Close();
+		} );
+}
+
+void pipeline_test()
+{
+	using clock = std::chrono::high_resolution_clock;
+
+	std::vector< as::ThreadExecutor > stages( 4 );
+	as::stream::channel<int> source( 256 );
+
+	auto doubled = as::stream::map( stages[0], source, [](int v) { return v * 2; } );
+	auto kept = as::stream::filter( stages[1], doubled, [](int const& v) { return v % 3 == 0; } );
+	auto twice = as::stream::flat_map( stages[2], kept,
+	                                   [](int v) { return std::vector<long long>{ v, v }; } );
+	auto groups = as::stream::batch( stages[3], twice, 100, std::chrono::milliseconds(5) );
+
+	const int count = items;
+	clock::time_point start = clock::now();
+
+	auto producer = produce( source, count );
+
+	long long sum = 0;
+	long long last = -1;
+	std::size_t received = 0;
+
+	for ( auto& group : groups ) {
+		assert( !group.empty() && group.size() <= 100 );
+
+		for ( auto v : group ) {
+			// single threaded stages keep their order
+			assert( v >= last );
+			last = v;
+			sum += v;
+			++received;
+		}
+	}
+
+	producer.join();
+
+	clock::duration elapsed = clock::now() - start;
+
+	long long expected = 0;
+	std::size_t expected_count = 0;
+
+	for ( long long i = 0; i < count; ++i )
+		if ( ( i * 2 ) % 3 == 0 ) {
+			expected += 4 * i;
+			expected_count += 2;
+		}
+
+	assert( sum == expected );
+	assert( received == expected_count );
+
+	std::cout << "4 stage pipeline: "
+	          << std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count() / count
+	          << " ns per element\n";
+}
+
+void batch_delay_test()
+{
+	as::ThreadExecutor ex;
+	as::stream::channel<int> in( 16 );
+
+	auto groups = as::stream::batch( ex, in, 10, std::chrono::milliseconds(20) );
+
+	for ( int i = 0; i < 3; ++i )
+		in.Put( as::continuing(i) );
+
+	// nothing else arrives, so the partial group goes out on time
+	auto group = groups.Get();
+	assert( group && group->size() == 3 );
+
+	in.Put( as::continuing(3) );
+	in.Close();
+
+	group = groups.Get();
+	assert( group && group->size() == 1 && (*group)[0] == 3 );
+	assert( !groups.Get() );
+
+	std::cout << "batch delay: OK\n";
+}
+
+void window_test()
+{
+	as::ThreadExecutor ex1, ex2;
+	as::stream::channel<int> in1( 16 ), in2( 16 );
+
+	auto sliding = as::stream::window( ex1, in1, 3 );
+	auto tumbling = as::stream::window( ex2, in2, 3, 3 );
+
+	for ( int i = 1; i <= 7; ++i ) {
+		in1.Put( as::continuing(i) );
+		in2.Put( as::continuing(i) );
+	}
+
+	in1.Close();
+	in2.Close();
+
+	for ( int first = 1; first <= 5; ++first )
+		assert( *sliding.Get() == ( std::vector<int>{ first, first + 1, first + 2 } ) );
+
+	assert( !sliding.Get() );
+
+	assert( *tumbling.Get() == ( std::vector<int>{ 1, 2, 3 } ) );
+	assert( *tumbling.Get() == ( std::vector<int>{ 4, 5, 6 } ) );
+	assert( !tumbling.Get() );
+
+	std::cout << "window: OK\n";
+}
+
+void parallel_map_test()
+{
+	std::vector< as::ThreadExecutor > workers( 4 );
+	as::stream::channel<int> in( 64 );
+
+	std::atomic<int> running{0};
+	std::atomic<int> peak{0};
+
+	auto squares = as::stream::parallel_map( workers, in, [&](int v) {
+			int now = ++running;
+			int seen = peak;
+
+			while( now > seen && !peak.compare_exchange_weak( seen, now ) )
+				;
+
+			std::this_thread::yield();
+			--running;
+
+			return (long long)v * v;
+		} );
+
+	const int count = 10000;
+	auto producer = produce( in, count );
+
+	long long sum = 0;
+
+	for ( auto v : squares )
+		sum += v;
+
+	producer.join();
+
+	long long expected = 0;
+
+	for ( long long i = 0; i < count; ++i )
+		expected += i * i;
+
+	assert( sum == expected );
+	assert( peak <= 4 );
+
+	std::cout << "parallel map: OK\n";
+}
+
+void backpressure_test()
+{
+	as::ThreadExecutor ex;
+	as::stream::channel<int> in( 16 );
+
+	auto out = as::stream::map( ex, in, [](int v) { return v; }, 16 );
+
+	std::atomic<int> produced{0};
+	auto producer = produce( in, 100000, &produced );
+
+	// nobody reads out: the producer stalls once the input ring, the
+	// stage's batch and the output ring are full
+	std::this_thread::sleep_for( std::chrono::milliseconds(100) );
+	assert( produced <= 16 + int(as::stream::default_batch) + 16 );
+
+	// closing the end of the pipeline stops the producer
+	out.Close();
+	producer.join();
+
+	assert( produced < 100000 );
+
+	std::cout << "backpressure: OK\n";
+}
+
+int main(int argc, char *argv[])
+{
+	if ( argc > 1 )
+		items = std::stoul( argv[1] );
+
+	pipeline_test();
+	batch_delay_test();
+	window_test();
+	parallel_map_test();
+	backpressure_test();
+}
@@ -0,0 +1,80 @@
+#define AS_USE_COROUTINE_TASKS
+
+#include "Await.hpp"
+#include "ThreadExecutor.hpp"
+
+#include <iostream>
+#include <cassert>
+
+namespace {
+int iterations = 1000000;
+}
+
+using clock_type = std::chrono::steady_clock;
+
+long long ns_per(clock_type::duration elapsed, long long count)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count() / count;
+}
+
+// Bare switch cost: the caller resumes the coroutine, which yields
+// straight back; every round trip is two switches
+void ping_pong_test()
+{
+	int yields = 0;
+
+	auto body = [&yields]() {
+		for ( int i = 0; i < iterations; ++i ) {
+			++yields;
+			as::this_task::yield();
+		}
+	};
+
+	as::CoroutineTaskImpl< decltype(body) > coro( body );
+
+	auto start = clock_type::now();
+
+	while( coro.Invoke() != as::TaskStatus::Finished )
+		;
+
+	auto elapsed = clock_type::now() - start;
+
+	assert( yields == iterations );
+
+	std::cout << "ping-pong: " << ns_per( elapsed, 2LL * iterations ) << " ns per switch\n";
+}
+
+// Two coroutines taking turns on one executor thread; includes the
+// executor requeueing each of them
+void executor_ping_pong_test()
+{
+	as::ThreadExecutor ex;
+
+	auto player = [&]() {
+		for ( int i = 0; i < iterations; ++i )
+			as::this_task::yield();
+	};
+
+	auto start = clock_type::now();
+
+	auto ping = as::await( ex, player );
+	auto pong = as::await( ex, player );
+
+	ping.get();
+	pong.get();
+
+	auto elapsed = clock_type::now() - start;
+
+	std::cout << "executor ping-pong: " << ns_per( elapsed, 2LL * iterations ) << " ns per yield\n";
+}
+
+int main(int argc, char *argv[])
+{
+	if ( argc > 1 )
+		iterations = std::stoi( argv[1] );
+
+	ping_pong_test();
+	executor_ping_pong_test();
+
+	return 0;
+}